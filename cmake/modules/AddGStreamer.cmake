@@ -16,7 +16,9 @@ find_package(PkgConfig)
 
 pkg_check_modules(GStreamer REQUIRED IMPORTED_TARGET gstreamer-1.0)
 pkg_check_modules(GStreamerBase REQUIRED IMPORTED_TARGET gstreamer-base-1.0)
+pkg_check_modules(GStreamerApp REQUIRED IMPORTED_TARGET gstreamer-app-1.0)
 pkg_check_modules(GStreamerAudio REQUIRED IMPORTED_TARGET gstreamer-audio-1.0)
 pkg_check_modules(GStreamerPbUtils REQUIRED IMPORTED_TARGET gstreamer-pbutils-1.0)
 pkg_check_modules(GStreamerPluginsBase REQUIRED IMPORTED_TARGET gstreamer-plugins-base-1.0)
 pkg_check_modules(GStreamerPluginsBad REQUIRED IMPORTED_TARGET gstreamer-plugins-bad-1.0)
+pkg_check_modules(GStreamerVideo REQUIRED IMPORTED_TARGET gstreamer-video-1.0)
@@ -0,0 +1,88 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <gst/pbutils/pbutils.h>
+
+/**
+ * Append-only index of serialized discoverer results.
+ *
+ * Each record keeps the URI, the mtime of the file it was discovered from and the
+ * GVariant of gst_discoverer_info_to_variant() in serialized form, 8-byte aligned,
+ * along with the serialize flags it was written with. On open the file is mapped and
+ * only record headers are scanned, the variant of a record is used in place (no copy)
+ * when the info is requested. The later record of the same URI supersedes the earlier
+ * one, unless it keeps fewer parts of the same file. Records appended after open()
+ * become visible on the next open().
+ */
+class DiscovererIndex {
+public:
+    explicit DiscovererIndex(std::filesystem::path path);
+
+    ~DiscovererIndex();
+
+    DiscovererIndex(const DiscovererIndex&) = delete;
+    DiscovererIndex&
+    operator=(const DiscovererIndex&) = delete;
+
+    /* Map the index and prepare it for appending, missing file is created */
+    bool
+    open(GError** error);
+
+    /**
+     * Returns the info of URI indexed with the same mtime and at least the required
+     * parts (unref after usage) or nullptr.
+     */
+    [[nodiscard]] GstDiscovererInfo*
+    lookup(const gchar* uri,
+           gint64 mtime,
+           GstDiscovererSerializeFlags required = GST_DISCOVERER_SERIALIZE_ALL) const;
+
+    bool
+    append(GstDiscovererInfo* info,
+           gint64 mtime,
+           GError** error,
+           GstDiscovererSerializeFlags flags = GST_DISCOVERER_SERIALIZE_ALL);
+
+    [[nodiscard]] gsize
+    size() const;
+
+    /* Returns mtime (ns) of local file URI */
+    static std::optional<gint64>
+    mtimeOf(const gchar* uri);
+
+private:
+    struct Slot {
+        gint64 mtime{};
+        GstDiscovererSerializeFlags flags{};
+        const gchar* type{};
+        gsize offset{};
+        gsize size{};
+    };
+
+    void
+    close();
+
+private:
+    std::filesystem::path _path;
+    int _fd{-1};
+    GBytes* _mapping{};
+    std::unordered_map<std::string, Slot> _slots;
+};
@@ -0,0 +1,40 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * Statistics of packed RGB frame.
+ *
+ * Variance is the luma-weighted sum of per-channel variances, which is zero for a
+ * frame of one color. Dark ratio is the share of channel samples not above the
+ * threshold, close to one for a black frame.
+ */
+struct FrameStats {
+    gdouble mean{};
+    gdouble variance{};
+    gdouble darkRatio{};
+};
+
+/* Rows of the frame are "stride" bytes apart, SSE2 is used when available */
+FrameStats
+computeRgbStats(
+    const guint8* data, gint width, gint height, gsize stride, guint8 darkThreshold = 24);
+
+/* Same statistics without SIMD, for comparison and for other architectures */
+FrameStats
+computeRgbStatsScalar(
+    const guint8* data, gint width, gint height, gsize stride, guint8 darkThreshold = 24);
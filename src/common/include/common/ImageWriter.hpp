@@ -0,0 +1,89 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gst/gst.h>
+
+enum class ImageFormat { Ppm, Png, Jpeg };
+
+/* Format by the path extension: ".png", ".jpg" or ".jpeg", PPM otherwise */
+ImageFormat
+imageFormatOf(const gchar* path);
+
+/**
+ * Write video sample as image of the path format.
+ *
+ * PPM is written from the mapped video frame row by row, so padded strides of any
+ * producer are honoured; samples of other than RGB format are converted first.
+ * PNG and JPEG are encoded by gst_video_convert_sample() with "pngenc" and "jpegenc".
+ */
+bool
+writeImage(GstSample* sample, const gchar* path, GError** error);
+
+/**
+ * Writes images on a worker thread.
+ *
+ * Producer queues the sample and goes on with the next one while the image is encoded.
+ * The queue is bounded: write() blocks while "maxPending" images wait, so memory is
+ * held by a few frames only. Completion callback runs on the worker thread.
+ */
+class ImageWriter {
+public:
+    using Done = std::function<void(const GError* error)>;
+
+    explicit ImageWriter(gsize maxPending = 8);
+
+    /* Writes out the queued images */
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter&
+    operator=(const ImageWriter&) = delete;
+
+    /* Queue the sample (a reference is taken) */
+    void
+    write(GstSample* sample, std::string path, Done done = {});
+
+    /* Wait until the queued images are written, returns the number of failures so far */
+    guint
+    finish();
+
+private:
+    struct Job {
+        GstSample* sample{};
+        std::string path;
+        Done done;
+    };
+
+    void
+    run();
+
+private:
+    const gsize _maxPending;
+    std::deque<Job> _jobs;
+    bool _busy{};
+    bool _stop{};
+    guint _failed{};
+    std::mutex _guard;
+    std::condition_variable _changed;
+    std::thread _thread;
+};
@@ -0,0 +1,110 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include <glib.h>
+
+/**
+ * Streaming writer of newline delimited JSON.
+ *
+ * Values are escaped straight into a fixed-size buffer which is written out when
+ * it is full, so memory doesn't depend on the size of a record. Each record is
+ * one top-level value terminated by endRecord(). Structure is not validated
+ * beyond tracking the separators.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(FILE* out, gsize bufferSize = 64 * 1024);
+
+    ~JsonWriter();
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter&
+    operator=(const JsonWriter&) = delete;
+
+    JsonWriter&
+    beginObject();
+
+    JsonWriter&
+    endObject();
+
+    JsonWriter&
+    beginArray();
+
+    JsonWriter&
+    endArray();
+
+    JsonWriter&
+    key(std::string_view name);
+
+    JsonWriter&
+    value(std::string_view str);
+
+    JsonWriter&
+    value(const gchar* str);
+
+    JsonWriter&
+    value(gint64 number);
+
+    JsonWriter&
+    value(guint64 number);
+
+    JsonWriter&
+    value(gint number);
+
+    JsonWriter&
+    value(guint number);
+
+    JsonWriter&
+    value(gdouble number);
+
+    JsonWriter&
+    value(bool flag);
+
+    JsonWriter&
+    null();
+
+    /* Terminate the record, data is written out when the buffer is full */
+    void
+    endRecord();
+
+    void
+    flush();
+
+private:
+    void
+    separate();
+
+    void
+    put(gchar c);
+
+    void
+    put(std::string_view str);
+
+    void
+    putEscaped(std::string_view str);
+
+private:
+    FILE* _out{};
+    std::vector<gchar> _buffer;
+    gsize _used{};
+    /* Whether the next value at each nesting level needs a comma */
+    std::vector<bool> _needComma;
+    bool _afterKey{};
+};
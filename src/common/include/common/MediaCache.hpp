@@ -0,0 +1,103 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <glib.h>
+
+/**
+ * Identity of a file content: the entry is valid while the file keeps its size and mtime.
+ */
+struct MediaCacheKey {
+    guint64 device{};
+    guint64 inode{};
+    guint64 size{};
+    gint64 mtime{}; /* ns */
+};
+
+struct MediaCacheEntry {
+    guint probability{};
+    std::string caps;
+    std::string summary;
+};
+
+/**
+ * Persistent cache of typefind caps and discoverer summaries.
+ *
+ * The file is memory-mapped as is and never parsed: a header, an array of fixed-size
+ * records sorted by (device, inode) and a table of deduplicated strings. Lookup is a
+ * binary search over the mapped records. Stored entries are kept in memory until
+ * flush(), which merges them with the mapped records and atomically replaces the file.
+ *
+ * Lookup and store may be called from several threads.
+ */
+class MediaCache {
+public:
+    explicit MediaCache(std::filesystem::path path);
+
+    ~MediaCache();
+
+    MediaCache(const MediaCache&) = delete;
+    MediaCache&
+    operator=(const MediaCache&) = delete;
+
+    /* Map the cache file, missing file is an empty cache */
+    bool
+    open(GError** error);
+
+    bool
+    flush(GError** error);
+
+    [[nodiscard]] std::optional<MediaCacheEntry>
+    lookup(const MediaCacheKey& key) const;
+
+    void
+    store(const MediaCacheKey& key, MediaCacheEntry entry);
+
+    static std::optional<MediaCacheKey>
+    keyOf(const std::filesystem::path& path);
+
+private:
+    struct Record;
+
+    using Id = std::pair<guint64, guint64>;
+
+    bool
+    map(GError** error);
+
+    [[nodiscard]] std::string
+    stringAt(guint32 offset, guint32 length) const;
+
+    void
+    unmap();
+
+private:
+    std::filesystem::path _path;
+    gpointer _data{};
+    gsize _dataSize{};
+    const Record* _records{};
+    gsize _count{};
+    const gchar* _strings{};
+    gsize _stringsSize{};
+
+    mutable std::mutex _guard;
+    std::map<Id, std::pair<MediaCacheKey, MediaCacheEntry>> _pending;
+};
@@ -0,0 +1,86 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gst/gst.h>
+
+/**
+ * Registry of task pools shared by the tasks of one pipeline.
+ *
+ * Pools are keyed by pipeline and task class (e.g. "capture", "encode", "io").
+ * The class of a task is selected by the first rule which glob pattern matches
+ * the path of the task owner element (e.g. "/pipeline/capture*"). Tasks not
+ * matched by any rule go to the "default" class.
+ */
+class TaskPoolRegistry {
+public:
+    using Factory = std::function<GstTaskPool*(const std::string& taskClass)>;
+
+    explicit TaskPoolRegistry(Factory factory);
+
+    ~TaskPoolRegistry();
+
+    TaskPoolRegistry(const TaskPoolRegistry&) = delete;
+    TaskPoolRegistry&
+    operator=(const TaskPoolRegistry&) = delete;
+
+    /* Route tasks whose owner path matches the pattern to the given class */
+    void
+    addClassRule(const std::string& pattern, const std::string& taskClass);
+
+    /* Parse comma-separated list of "<pattern>=<class>" rules */
+    bool
+    parseClassRules(const gchar* rules);
+
+    [[nodiscard]] std::string
+    classify(const gchar* ownerPath) const;
+
+    /* Assign the shared pool of the owner class to the task (on STREAM_STATUS CREATE) */
+    bool
+    assign(GstElement* pipeline, GstElement* owner, GstTask* task);
+
+    /* Forget the task membership (on STREAM_STATUS DESTROY) */
+    void
+    unassign(GstTask* task);
+
+    /* Cleanup and release all pools of the pipeline (after it has reached NULL state) */
+    void
+    release(GstElement* pipeline);
+
+    /* Print pools and their member tasks */
+    void
+    dump() const;
+
+private:
+    struct Entry {
+        GstTaskPool* pool{};
+        std::string pipelineName;
+        std::map<GstTask*, std::string> members;
+    };
+
+    using Key = std::pair<GstElement*, std::string>;
+
+    Factory _factory;
+    std::vector<std::pair<std::string, std::string>> _rules;
+    std::map<Key, Entry> _entries;
+    mutable std::mutex _guard;
+};
@@ -0,0 +1,79 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+/**
+ * Scheduling settings of a streaming thread.
+ */
+struct ThreadPolicy {
+    std::string name;
+    std::string pattern;
+    std::vector<int> cpus;
+    std::optional<int> policy;
+    int priority{};
+    std::optional<int> nice;
+};
+
+/**
+ * Map of element path globs to thread scheduling settings.
+ *
+ * The config file is a key file where each group is a rule, rules are
+ * checked in the order of appearance and the first match wins:
+ *
+ *   [capture]
+ *   match=/pipeline/capture*
+ *   cpus=2-3
+ *   policy=fifo
+ *   priority=80
+ *
+ *   [encode]
+ *   match=/pipeline/enc*
+ *   cpus=4-15
+ *   policy=other
+ *   nice=-5
+ *
+ * Supported policies: other, batch, idle, fifo, rr. Priority is required by fifo
+ * and rr (in the range of the policy), others take 0 only; nice is in -20..19.
+ * Invalid values fail the load with the group named.
+ */
+class ThreadPolicyMap {
+public:
+    bool
+    load(const std::filesystem::path& path, GError** error);
+
+    [[nodiscard]] bool
+    empty() const;
+
+    [[nodiscard]] const ThreadPolicy*
+    find(const gchar* elementPath) const;
+
+    /* Apply the policy matching the element path to the calling thread */
+    bool
+    applyFor(const gchar* elementPath) const;
+
+    /* Apply the policy to the calling thread */
+    static bool
+    apply(const ThreadPolicy& policy);
+
+private:
+    std::vector<ThreadPolicy> _policies;
+};
@@ -0,0 +1,73 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+
+#include <gst/gst.h>
+
+/* Amount of file header mapped for pipeline-free typefinding */
+constexpr gsize kTypeFindHeaderSize = 256 * 1024;
+
+/* Time given to the pipeline to preroll a file */
+constexpr GstClockTime kTypeFindTimeout = 5 * GST_SECOND;
+
+/**
+ * Reusable "filesrc ! typefind ! fakesink" pipeline. Switching to the next file
+ * only changes the location in READY state, so elements are created once.
+ */
+class TypeFinder {
+public:
+    explicit TypeFinder(GstClockTime timeout = kTypeFindTimeout);
+
+    ~TypeFinder();
+
+    TypeFinder(const TypeFinder&) = delete;
+    TypeFinder&
+    operator=(const TypeFinder&) = delete;
+
+    /* Returns found caps (unref after usage) or nullptr, also if preroll timed out */
+    GstCaps*
+    find(const std::filesystem::path& path, GstTypeFindProbability* probability);
+
+private:
+    static void
+    onHaveType(GstElement* typefind, guint probability, GstCaps* caps, gpointer data);
+
+private:
+    GstClockTime _timeout{};
+    GstElement* _pipeline{};
+    GstElement* _src{};
+    GstCaps* _caps{};
+    guint _probability{};
+};
+
+/**
+ * Typefind the file without pipeline: map the first bytes of the file and run
+ * typefinders on them directly. Returns found caps (unref after usage) or nullptr.
+ */
+GstCaps*
+typeFindFileHeader(const std::filesystem::path& path,
+                   GstTypeFindProbability* probability,
+                   gsize headerSize = kTypeFindHeaderSize);
+
+/**
+ * Typefind the file by header and fall back to the pipeline only when the result is
+ * inconclusive (nothing found or less than likely). The finder is created on demand.
+ */
+GstCaps*
+typeFindFile(const std::filesystem::path& path,
+             GstTypeFindProbability* probability,
+             TypeFinder* finder = nullptr);
@@ -32,3 +32,10 @@ printAllPadCaps(GstElement* element, const gchar* padName);
 
 void
 printPadTemplatesInfo(GstElementFactory* factory);
+
+/**
+ * Read URI list (one URI or file path per line, # starts a comment). Returns the array
+ * of URIs (unref after usage) or nullptr if the list is unreadable or empty.
+ */
+GPtrArray*
+readUriList(const gchar* path);
@@ -0,0 +1,333 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/DiscovererIndex.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr gchar kMagic[8] = {'G', 'S', 'T', 'D', 'I', 'N', 'D', 'X'};
+constexpr guint32 kVersion = 2;
+
+/* Variant layout depends on the GStreamer version, the index is rebuilt on upgrade */
+struct FileHeader {
+    gchar magic[8];
+    guint32 version;
+    guint32 gstVersion;
+};
+
+/* Serialize flags tell which parts of the info the record keeps */
+struct RecordHeader {
+    guint32 uriLength;
+    guint32 typeLength;
+    guint64 dataSize;
+    gint64 mtime;
+    guint32 flags;
+    guint32 reserved;
+};
+
+static_assert(sizeof(FileHeader) == 16);
+static_assert(sizeof(RecordHeader) == 32);
+
+struct Mapping {
+    gpointer data;
+    gsize size;
+};
+
+constexpr gsize
+align8(const gsize value)
+{
+    return (value + 7) & ~gsize{7};
+}
+
+guint32
+gstVersion()
+{
+    guint major{}, minor{}, micro{}, nano{};
+    gst_version(&major, &minor, &micro, &nano);
+    return (major << 16) | (minor << 8) | micro;
+}
+
+void
+unmapFile(gpointer data)
+{
+    auto* mapping = static_cast<Mapping*>(data);
+    munmap(mapping->data, mapping->size);
+    delete mapping;
+}
+
+bool
+writeAll(const int fd, const gchar* data, gsize size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool
+resetFile(const int fd)
+{
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.gstVersion = gstVersion();
+    return ftruncate(fd, 0) == 0
+           and writeAll(fd, reinterpret_cast<const gchar*>(&header), sizeof(header));
+}
+
+} // namespace
+
+DiscovererIndex::DiscovererIndex(std::filesystem::path path)
+    : _path{std::move(path)}
+{
+}
+
+DiscovererIndex::~DiscovererIndex()
+{
+    close();
+}
+
+bool
+DiscovererIndex::open(GError** error)
+{
+    close();
+
+    /* Appends always go to the end, even after truncating corrupted tail */
+    _fd = ::open(_path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st{};
+    if (_fd < 0 or fstat(_fd, &st) != 0) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Unable to open index %s: %s",
+                    _path.c_str(),
+                    g_strerror(errno));
+        close();
+        return false;
+    }
+
+    const gsize fileSize = st.st_size;
+    FileHeader header{};
+    if (fileSize < sizeof(FileHeader)
+        or pread(_fd, &header, sizeof(header), 0) != ssize_t{sizeof(header)}
+        or std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 or header.version != kVersion
+        or header.gstVersion != gstVersion()) {
+        if (fileSize != 0) {
+            g_message("Index %s is incompatible, rebuilding", _path.c_str());
+        }
+        if (not resetFile(_fd)) {
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Unable to reset index %s: %s",
+                        _path.c_str(),
+                        g_strerror(errno));
+            close();
+            return false;
+        }
+        return true;
+    }
+    if (fileSize == sizeof(FileHeader)) {
+        return true;
+    }
+
+    void* data = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Unable to map index %s: %s",
+                    _path.c_str(),
+                    g_strerror(errno));
+        close();
+        return false;
+    }
+    /* Variants created from the index keep the mapping alive */
+    _mapping = g_bytes_new_with_free_func(data, fileSize, unmapFile, new Mapping{data, fileSize});
+
+    /* Only headers are touched, the variant data stays on disk until requested */
+    const auto* base = static_cast<const gchar*>(data);
+    gsize offset = sizeof(FileHeader);
+    while (offset + sizeof(RecordHeader) <= fileSize) {
+        RecordHeader record{};
+        std::memcpy(&record, base + offset, sizeof(record));
+
+        const gsize available = fileSize - offset;
+        const gsize dataOffset
+            = align8(sizeof(RecordHeader) + gsize{record.uriLength} + record.typeLength + 2);
+        if (dataOffset > available or record.dataSize > available - dataOffset
+            or align8(dataOffset + record.dataSize) > available) {
+            break;
+        }
+        const gchar* uri = base + offset + sizeof(RecordHeader);
+        const gchar* type = uri + record.uriLength + 1;
+        if (uri[record.uriLength] != '\0' or type[record.typeLength] != '\0'
+            or not g_variant_type_string_is_valid(type)) {
+            break;
+        }
+
+        /* Record of the same file with fewer parts doesn't replace the complete one */
+        const Slot slot{record.mtime,
+                        static_cast<GstDiscovererSerializeFlags>(record.flags),
+                        type,
+                        offset + dataOffset,
+                        gsize(record.dataSize)};
+        const auto [it, inserted] = _slots.try_emplace(std::string{uri, record.uriLength}, slot);
+        const gboolean richer = (slot.flags & it->second.flags) == it->second.flags;
+        if (not inserted and (it->second.mtime != slot.mtime or richer)) {
+            it->second = slot;
+        }
+        offset += align8(dataOffset + record.dataSize);
+    }
+
+    /* Tail of interrupted append, drop it so the next record follows a valid one */
+    if (offset != fileSize) {
+        g_message("Index %s is truncated at %" G_GSIZE_FORMAT " bytes", _path.c_str(), offset);
+        if (ftruncate(_fd, offset) != 0) {
+            g_set_error(error,
+                        G_FILE_ERROR,
+                        g_file_error_from_errno(errno),
+                        "Unable to truncate index %s: %s",
+                        _path.c_str(),
+                        g_strerror(errno));
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+GstDiscovererInfo*
+DiscovererIndex::lookup(const gchar* uri,
+                        const gint64 mtime,
+                        const GstDiscovererSerializeFlags required) const
+{
+    const auto it = _slots.find(uri);
+    if (it == _slots.end() or it->second.mtime != mtime
+        or (it->second.flags & required) != required) {
+        return nullptr;
+    }
+
+    const Slot& slot = it->second;
+    GBytes* bytes = g_bytes_new_from_bytes(_mapping, slot.offset, slot.size);
+    GVariant* variant
+        = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(slot.type), bytes, FALSE));
+    g_bytes_unref(bytes);
+
+    GstDiscovererInfo* info = gst_discoverer_info_from_variant(variant);
+    g_variant_unref(variant);
+    return info;
+}
+
+bool
+DiscovererIndex::append(GstDiscovererInfo* info,
+                        const gint64 mtime,
+                        GError** error,
+                        const GstDiscovererSerializeFlags flags)
+{
+    g_return_val_if_fail(_fd >= 0, false);
+
+    GVariant* variant = gst_discoverer_info_to_variant(info, flags);
+    if (variant == nullptr) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Unable to serialize info");
+        return false;
+    }
+    g_variant_take_ref(variant);
+
+    const gchar* uri = gst_discoverer_info_get_uri(info);
+    const gchar* type = g_variant_get_type_string(variant);
+    RecordHeader record{static_cast<guint32>(strlen(uri)),
+                        static_cast<guint32>(strlen(type)),
+                        g_variant_get_size(variant),
+                        mtime,
+                        static_cast<guint32>(flags),
+                        0};
+
+    /* The whole record goes with one write, partial record is dropped on next open */
+    std::string buffer;
+    buffer.append(reinterpret_cast<const gchar*>(&record), sizeof(record));
+    buffer.append(uri, record.uriLength + 1);
+    buffer.append(type, record.typeLength + 1);
+    buffer.resize(align8(buffer.size()), '\0');
+    if (record.dataSize > 0) {
+        buffer.append(static_cast<const gchar*>(g_variant_get_data(variant)), record.dataSize);
+    }
+    buffer.resize(align8(buffer.size()), '\0');
+    g_variant_unref(variant);
+
+    if (not writeAll(_fd, buffer.data(), buffer.size())) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Unable to append to index %s: %s",
+                    _path.c_str(),
+                    g_strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+gsize
+DiscovererIndex::size() const
+{
+    return _slots.size();
+}
+
+std::optional<gint64>
+DiscovererIndex::mtimeOf(const gchar* uri)
+{
+    gchar* path = g_filename_from_uri(uri, nullptr, nullptr);
+    if (path == nullptr) {
+        return std::nullopt;
+    }
+
+    struct stat st{};
+    const int rc = stat(path, &st);
+    g_free(path);
+    if (rc != 0) {
+        return std::nullopt;
+    }
+    return gint64{st.st_mtim.tv_sec} * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+}
+
+void
+DiscovererIndex::close()
+{
+    _slots.clear();
+    if (_mapping != nullptr) {
+        g_bytes_unref(_mapping);
+        _mapping = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
@@ -0,0 +1,167 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/FrameStats.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/* Per-channel sums of samples and squares, count of dark samples */
+struct Accumulator {
+    guint64 sums[3]{};
+    guint64 squares[3]{};
+    guint64 dark{};
+};
+
+void
+accumulateScalar(const guint8* row, gint pixels, const guint8 threshold, Accumulator& acc)
+{
+    for (int i = 0; i < pixels; ++i, row += 3) {
+        for (int c = 0; c < 3; ++c) {
+            const guint32 value = row[c];
+            acc.sums[c] += value;
+            acc.squares[c] += value * value;
+            acc.dark += (value <= threshold) ? 1 : 0;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+/**
+ * Process blocks of 16 pixels (48 bytes, three registers). Byte lane of a block keeps
+ * the same channel, so lanes are summed separately and folded into channels once per
+ * chunk. Chunk of 255 blocks keeps 16-bit sums, 32-bit squares and 8-bit dark counters
+ * from overflowing.
+ */
+void
+accumulateSse2(const guint8* row, gsize blocks, const guint8 threshold, Accumulator& acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+
+    while (blocks > 0) {
+        const gsize chunk = std::min<gsize>(blocks, 255);
+        __m128i sums[6] = {zero, zero, zero, zero, zero, zero};
+        __m128i squares[12]
+            = {zero, zero, zero, zero, zero, zero, zero, zero, zero, zero, zero, zero};
+        __m128i dark[3] = {zero, zero, zero};
+
+        for (gsize b = 0; b < chunk; ++b, row += 48) {
+            for (int k = 0; k < 3; ++k) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 16 * k));
+                const __m128i lo = _mm_unpacklo_epi8(v, zero);
+                const __m128i hi = _mm_unpackhi_epi8(v, zero);
+                sums[2 * k] = _mm_add_epi16(sums[2 * k], lo);
+                sums[2 * k + 1] = _mm_add_epi16(sums[2 * k + 1], hi);
+
+                /* Squares of bytes fit unsigned 16 bits */
+                const __m128i lo2 = _mm_mullo_epi16(lo, lo);
+                const __m128i hi2 = _mm_mullo_epi16(hi, hi);
+                squares[4 * k] = _mm_add_epi32(squares[4 * k], _mm_unpacklo_epi16(lo2, zero));
+                squares[4 * k + 1]
+                    = _mm_add_epi32(squares[4 * k + 1], _mm_unpackhi_epi16(lo2, zero));
+                squares[4 * k + 2]
+                    = _mm_add_epi32(squares[4 * k + 2], _mm_unpacklo_epi16(hi2, zero));
+                squares[4 * k + 3]
+                    = _mm_add_epi32(squares[4 * k + 3], _mm_unpackhi_epi16(hi2, zero));
+
+                /* min(v, limit) == v for samples not above the limit, mask is -1 */
+                const __m128i isDark = _mm_cmpeq_epi8(_mm_min_epu8(v, limit), v);
+                dark[k] = _mm_sub_epi8(dark[k], isDark);
+            }
+        }
+
+        alignas(16) uint16_t laneSums[48];
+        alignas(16) guint32 laneSquares[48];
+        for (int k = 0; k < 6; ++k) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(laneSums + 8 * k), sums[k]);
+        }
+        for (int k = 0; k < 12; ++k) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(laneSquares + 4 * k), squares[k]);
+        }
+        for (int lane = 0; lane < 48; ++lane) {
+            acc.sums[lane % 3] += laneSums[lane];
+            acc.squares[lane % 3] += laneSquares[lane];
+        }
+        for (int k = 0; k < 3; ++k) {
+            const __m128i total = _mm_sad_epu8(dark[k], zero);
+            acc.dark += static_cast<guint32>(_mm_cvtsi128_si32(total))
+                        + static_cast<guint32>(_mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+        }
+        blocks -= chunk;
+    }
+}
+#endif
+
+FrameStats
+finish(const Accumulator& acc, const guint64 samples)
+{
+    static constexpr gdouble kWeights[3] = {0.299, 0.587, 0.114};
+
+    FrameStats stats;
+    if (samples == 0) {
+        return stats;
+    }
+    const gdouble count = static_cast<gdouble>(samples / 3);
+    for (int c = 0; c < 3; ++c) {
+        const gdouble mean = acc.sums[c] / count;
+        const gdouble variance = std::max(0.0, acc.squares[c] / count - mean * mean);
+        stats.mean += kWeights[c] * mean;
+        stats.variance += kWeights[c] * variance;
+    }
+    stats.darkRatio = static_cast<gdouble>(acc.dark) / samples;
+    return stats;
+}
+
+} // namespace
+
+FrameStats
+computeRgbStats(const guint8* data,
+                const gint width,
+                const gint height,
+                const gsize stride,
+                const guint8 darkThreshold)
+{
+#if defined(__SSE2__)
+    Accumulator acc;
+    const gsize blocks = width / 16;
+    for (int y = 0; y < height; ++y) {
+        const guint8* row = data + y * stride;
+        accumulateSse2(row, blocks, darkThreshold, acc);
+        accumulateScalar(row + blocks * 48, width - blocks * 16, darkThreshold, acc);
+    }
+    return finish(acc, guint64(std::max(width, 0)) * std::max(height, 0) * 3);
+#else
+    return computeRgbStatsScalar(data, width, height, stride, darkThreshold);
+#endif
+}
+
+FrameStats
+computeRgbStatsScalar(const guint8* data,
+                      const gint width,
+                      const gint height,
+                      const gsize stride,
+                      const guint8 darkThreshold)
+{
+    Accumulator acc;
+    for (int y = 0; y < height; ++y) {
+        accumulateScalar(data + y * stride, width, darkThreshold, acc);
+    }
+    return finish(acc, guint64(std::max(width, 0)) * std::max(height, 0) * 3);
+}
@@ -0,0 +1,207 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/ImageWriter.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <gst/video/video.h>
+
+namespace {
+
+constexpr GstClockTime kEncodeTimeout = 5 * GST_SECOND;
+
+bool
+writePpm(const GstVideoFrame& frame, const gchar* path, GError** error)
+{
+    const gint width = GST_VIDEO_FRAME_WIDTH(&frame);
+    const gint height = GST_VIDEO_FRAME_HEIGHT(&frame);
+    const gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+    const auto* data = static_cast<const guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0));
+
+    FILE* file = fopen(path, "wb");
+    bool ok = (file != nullptr);
+    if (ok) {
+        ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+        for (gint row = 0; ok and row < height; ++row) {
+            ok = fwrite(data + row * stride, 1, width * 3, file) == gsize(width) * 3;
+        }
+        ok = (fclose(file) == 0) and ok;
+    }
+    if (not ok) {
+        g_set_error(
+            error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_WRITE, "Unable to write %s", path);
+    }
+    return ok;
+}
+
+/* Returns the sample in the caps format (unref after usage) or nullptr */
+GstSample*
+convertSample(GstSample* sample, const gchar* caps, GError** error)
+{
+    GstCaps* target = gst_caps_from_string(caps);
+    GstSample* converted = gst_video_convert_sample(sample, target, kEncodeTimeout, error);
+    gst_caps_unref(target);
+    return converted;
+}
+
+bool
+saveRgb(GstSample* sample, const gchar* path, GError** error)
+{
+    GstVideoInfo info;
+    if (not gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FORMAT, "Not a video frame");
+        return false;
+    }
+
+    GstVideoFrame frame;
+    if (not gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample), GST_MAP_READ)) {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "Unable to map frame");
+        return false;
+    }
+    const bool ok = writePpm(frame, path, error);
+    gst_video_frame_unmap(&frame);
+    return ok;
+}
+
+bool
+saveEncoded(GstSample* sample, const gchar* caps, const gchar* path, GError** error)
+{
+    GstSample* encoded = convertSample(sample, caps, error);
+    if (encoded == nullptr) {
+        return false;
+    }
+
+    GstBuffer* buffer = gst_sample_get_buffer(encoded);
+    GstMapInfo map;
+    bool ok = gst_buffer_map(buffer, &map, GST_MAP_READ);
+    if (ok) {
+        ok = g_file_set_contents(path, reinterpret_cast<const gchar*>(map.data), map.size, error);
+        gst_buffer_unmap(buffer, &map);
+    } else {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "Unable to map image");
+    }
+    gst_sample_unref(encoded);
+    return ok;
+}
+
+} // namespace
+
+ImageFormat
+imageFormatOf(const gchar* path)
+{
+    const gchar* dot = strrchr(path, '.');
+    if (dot == nullptr) {
+        return ImageFormat::Ppm;
+    }
+    if (g_ascii_strcasecmp(dot, ".png") == 0) {
+        return ImageFormat::Png;
+    }
+    if (g_ascii_strcasecmp(dot, ".jpg") == 0 or g_ascii_strcasecmp(dot, ".jpeg") == 0) {
+        return ImageFormat::Jpeg;
+    }
+    return ImageFormat::Ppm;
+}
+
+bool
+writeImage(GstSample* sample, const gchar* path, GError** error)
+{
+    switch (imageFormatOf(path)) {
+    case ImageFormat::Png:
+        return saveEncoded(sample, "image/png", path, error);
+    case ImageFormat::Jpeg:
+        return saveEncoded(sample, "image/jpeg", path, error);
+    case ImageFormat::Ppm:
+        break;
+    }
+
+    const GstStructure* s = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+    if (g_strcmp0(gst_structure_get_string(s, "format"), "RGB") == 0) {
+        return saveRgb(sample, path, error);
+    }
+    GstSample* rgb = convertSample(sample, "video/x-raw,format=RGB", error);
+    if (rgb == nullptr) {
+        return false;
+    }
+    const bool ok = saveRgb(rgb, path, error);
+    gst_sample_unref(rgb);
+    return ok;
+}
+
+ImageWriter::ImageWriter(const gsize maxPending)
+    : _maxPending{MAX(maxPending, gsize{1})}
+    , _thread{&ImageWriter::run, this}
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::lock_guard lock{_guard};
+        _stop = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+}
+
+void
+ImageWriter::write(GstSample* sample, std::string path, Done done)
+{
+    std::unique_lock lock{_guard};
+    _changed.wait(lock, [this] { return _jobs.size() < _maxPending; });
+    _jobs.push_back(Job{gst_sample_ref(sample), std::move(path), std::move(done)});
+    lock.unlock();
+    _changed.notify_all();
+}
+
+guint
+ImageWriter::finish()
+{
+    std::unique_lock lock{_guard};
+    _changed.wait(lock, [this] { return _jobs.empty() and not _busy; });
+    return _failed;
+}
+
+void
+ImageWriter::run()
+{
+    std::unique_lock lock{_guard};
+    while (true) {
+        _changed.wait(lock, [this] { return _stop or not _jobs.empty(); });
+        if (_jobs.empty()) {
+            /* Stopped and nothing is left */
+            break;
+        }
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _busy = true;
+        lock.unlock();
+        _changed.notify_all();
+
+        GError* error{};
+        const bool ok = writeImage(job.sample, job.path.c_str(), &error);
+        if (job.done) {
+            job.done(error);
+        }
+        g_clear_error(&error);
+        gst_sample_unref(job.sample);
+
+        lock.lock();
+        _failed += ok ? 0 : 1;
+        _busy = false;
+        _changed.notify_all();
+    }
+}
@@ -0,0 +1,259 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/JsonWriter.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+JsonWriter::JsonWriter(FILE* out, const gsize bufferSize)
+    : _out{out}
+    , _buffer(MAX(bufferSize, gsize{64}))
+{
+}
+
+JsonWriter::~JsonWriter()
+{
+    flush();
+}
+
+JsonWriter&
+JsonWriter::beginObject()
+{
+    separate();
+    put('{');
+    _needComma.push_back(false);
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::endObject()
+{
+    _needComma.pop_back();
+    put('}');
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::beginArray()
+{
+    separate();
+    put('[');
+    _needComma.push_back(false);
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::endArray()
+{
+    _needComma.pop_back();
+    put(']');
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::key(const std::string_view name)
+{
+    separate();
+    put('"');
+    putEscaped(name);
+    put("\":");
+    _afterKey = true;
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::value(const std::string_view str)
+{
+    separate();
+    put('"');
+    putEscaped(str);
+    put('"');
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::value(const gchar* str)
+{
+    return (str == nullptr) ? null() : value(std::string_view{str});
+}
+
+JsonWriter&
+JsonWriter::value(const gint64 number)
+{
+    separate();
+    gchar str[24];
+    const auto result = std::to_chars(str, str + sizeof(str), number);
+    put(std::string_view{str, static_cast<gsize>(result.ptr - str)});
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::value(const guint64 number)
+{
+    separate();
+    gchar str[24];
+    const auto result = std::to_chars(str, str + sizeof(str), number);
+    put(std::string_view{str, static_cast<gsize>(result.ptr - str)});
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::value(const gint number)
+{
+    return value(gint64{number});
+}
+
+JsonWriter&
+JsonWriter::value(const guint number)
+{
+    return value(guint64{number});
+}
+
+JsonWriter&
+JsonWriter::value(const gdouble number)
+{
+    if (not std::isfinite(number)) {
+        return null();
+    }
+    separate();
+    gchar str[G_ASCII_DTOSTR_BUF_SIZE];
+    put(g_ascii_dtostr(str, sizeof(str), number));
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::value(const bool flag)
+{
+    separate();
+    put(flag ? "true" : "false");
+    return *this;
+}
+
+JsonWriter&
+JsonWriter::null()
+{
+    separate();
+    put("null");
+    return *this;
+}
+
+void
+JsonWriter::endRecord()
+{
+    put('\n');
+    _needComma.clear();
+    _afterKey = false;
+}
+
+void
+JsonWriter::flush()
+{
+    if (_used > 0) {
+        fwrite(_buffer.data(), 1, _used, _out);
+        _used = 0;
+    }
+    fflush(_out);
+}
+
+void
+JsonWriter::separate()
+{
+    if (_afterKey) {
+        _afterKey = false;
+        return;
+    }
+    if (not _needComma.empty()) {
+        if (_needComma.back()) {
+            put(',');
+        }
+        _needComma.back() = true;
+    }
+}
+
+void
+JsonWriter::put(const gchar c)
+{
+    if (_used == _buffer.size()) {
+        flush();
+    }
+    _buffer[_used++] = c;
+}
+
+void
+JsonWriter::put(std::string_view str)
+{
+    while (not str.empty()) {
+        if (_used == _buffer.size()) {
+            flush();
+        }
+        const gsize n = MIN(str.size(), _buffer.size() - _used);
+        std::memcpy(_buffer.data() + _used, str.data(), n);
+        _used += n;
+        str.remove_prefix(n);
+    }
+}
+
+void
+JsonWriter::putEscaped(std::string_view str)
+{
+    static constexpr gchar kHex[] = "0123456789abcdef";
+
+    while (not str.empty()) {
+        /* Tags may come from broken files, invalid UTF-8 is replaced byte by byte */
+        const gchar* end{};
+        const bool valid = g_utf8_validate_len(str.data(), str.size(), &end);
+        const gsize validSize = end - str.data();
+
+        gsize plain{};
+        for (gsize i = 0; i < validSize; ++i) {
+            const auto c = static_cast<guchar>(str[i]);
+            if (c >= 0x20 and c != '"' and c != '\\') {
+                continue;
+            }
+            put(str.substr(plain, i - plain));
+            plain = i + 1;
+            switch (c) {
+            case '"':
+                put("\\\"");
+                break;
+            case '\\':
+                put("\\\\");
+                break;
+            case '\n':
+                put("\\n");
+                break;
+            case '\r':
+                put("\\r");
+                break;
+            case '\t':
+                put("\\t");
+                break;
+            default: {
+                const gchar escaped[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+                put(std::string_view{escaped, sizeof(escaped)});
+                break;
+            }
+            }
+        }
+        put(str.substr(plain, validSize - plain));
+        str.remove_prefix(validSize);
+
+        if (not valid) {
+            put("\\ufffd");
+            str.remove_prefix(1);
+        }
+    }
+}
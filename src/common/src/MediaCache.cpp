@@ -0,0 +1,316 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/MediaCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Records and header are stored in host byte order, the cache is local to the machine */
+struct MediaCache::Record {
+    guint64 device;
+    guint64 inode;
+    guint64 size;
+    gint64 mtime;
+    guint32 probability;
+    guint32 capsOffset;
+    guint32 capsLength;
+    guint32 summaryOffset;
+    guint32 summaryLength;
+    guint32 reserved;
+};
+
+namespace {
+
+constexpr gchar kMagic[8] = {'G', 'S', 'T', 'M', 'C', 'A', 'C', 'H'};
+constexpr guint32 kVersion = 1;
+
+struct Header {
+    gchar magic[8];
+    guint32 version;
+    guint32 recordSize;
+    guint64 count;
+    guint64 stringsSize;
+};
+
+static_assert(sizeof(Header) == 32);
+
+/* Deduplicating string table, most of caps strings are the same across the library */
+class StringTable {
+public:
+    bool
+    add(const std::string& value, guint32& offset, guint32& length)
+    {
+        if (value.empty()) {
+            offset = length = 0;
+            return true;
+        }
+        if (auto it = _offsets.find(value); it != _offsets.end()) {
+            offset = it->second;
+        } else {
+            if (_data.size() + value.size() + 1 > G_MAXUINT32) {
+                return false;
+            }
+            offset = static_cast<guint32>(_data.size());
+            _data.append(value).push_back('\0');
+            _offsets.emplace(value, offset);
+        }
+        length = static_cast<guint32>(value.size());
+        return true;
+    }
+
+    [[nodiscard]] const std::string&
+    data() const
+    {
+        return _data;
+    }
+
+private:
+    std::string _data;
+    std::unordered_map<std::string, guint32> _offsets;
+};
+
+} // namespace
+
+MediaCache::MediaCache(std::filesystem::path path)
+    : _path{std::move(path)}
+{
+}
+
+MediaCache::~MediaCache()
+{
+    unmap();
+}
+
+bool
+MediaCache::open(GError** error)
+{
+    std::lock_guard lock{_guard};
+    return map(error);
+}
+
+bool
+MediaCache::map(GError** error)
+{
+    static_assert(sizeof(Record) == 56);
+
+    unmap();
+
+    const int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Unable to open cache %s: %s",
+                    _path.c_str(),
+                    g_strerror(errno));
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 or st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(errno),
+                    "Unable to map cache %s: %s",
+                    _path.c_str(),
+                    g_strerror(errno));
+        return false;
+    }
+    _data = data;
+    _dataSize = st.st_size;
+
+    const auto* header = static_cast<const Header*>(_data);
+    const gsize available = _dataSize - MIN(_dataSize, sizeof(Header));
+    if (_dataSize < sizeof(Header) or std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+        or header->version != kVersion or header->recordSize != sizeof(Record)
+        or header->count > available / sizeof(Record)
+        or header->stringsSize != available - header->count * sizeof(Record)) {
+        unmap();
+        g_set_error(
+            error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid cache file %s", _path.c_str());
+        return false;
+    }
+
+    _records = reinterpret_cast<const Record*>(static_cast<const gchar*>(_data) + sizeof(Header));
+    _count = header->count;
+    _strings = reinterpret_cast<const gchar*>(_records + _count);
+    _stringsSize = header->stringsSize;
+    madvise(_data, _dataSize, MADV_RANDOM);
+    return true;
+}
+
+bool
+MediaCache::flush(GError** error)
+{
+    std::lock_guard lock{_guard};
+    if (_pending.empty()) {
+        return true;
+    }
+
+    std::vector<Record> records;
+    records.reserve(_count + _pending.size());
+    StringTable strings;
+    bool ok{true};
+
+    auto addPending = [&](const MediaCacheKey& key, const MediaCacheEntry& entry) {
+        Record& record = records.emplace_back(Record{key.device, key.inode, key.size, key.mtime});
+        record.probability = entry.probability;
+        ok = ok and strings.add(entry.caps, record.capsOffset, record.capsLength);
+        ok = ok and strings.add(entry.summary, record.summaryOffset, record.summaryLength);
+    };
+
+    /* Both sources are sorted by id, pending entries replace the mapped ones */
+    auto it = _pending.begin();
+    for (gsize i = 0; i < _count; ++i) {
+        const Record& mapped = _records[i];
+        const Id id{mapped.device, mapped.inode};
+        for (; it != _pending.end() and it->first < id; ++it) {
+            addPending(it->second.first, it->second.second);
+        }
+        if (it != _pending.end() and it->first == id) {
+            continue;
+        }
+        Record& record = records.emplace_back(mapped);
+        ok = ok
+             and strings.add(stringAt(mapped.capsOffset, mapped.capsLength),
+                             record.capsOffset,
+                             record.capsLength);
+        ok = ok
+             and strings.add(stringAt(mapped.summaryOffset, mapped.summaryLength),
+                             record.summaryOffset,
+                             record.summaryLength);
+    }
+    for (; it != _pending.end(); ++it) {
+        addPending(it->second.first, it->second.second);
+    }
+    if (not ok) {
+        g_set_error(
+            error, G_FILE_ERROR, G_FILE_ERROR_NOSPC, "Cache %s is too large", _path.c_str());
+        return false;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.recordSize = sizeof(Record);
+    header.count = records.size();
+    header.stringsSize = strings.data().size();
+
+    std::string out;
+    out.reserve(sizeof(Header) + records.size() * sizeof(Record) + strings.data().size());
+    out.append(reinterpret_cast<const gchar*>(&header), sizeof(Header));
+    out.append(reinterpret_cast<const gchar*>(records.data()), records.size() * sizeof(Record));
+    out.append(strings.data());
+
+    /* Written to the temporary file and renamed, readers never see partial cache */
+    if (not g_file_set_contents(_path.c_str(), out.data(), out.size(), error)) {
+        return false;
+    }
+    _pending.clear();
+
+    /* Existing mapping still refers to the replaced file, switch to the new one */
+    return map(error);
+}
+
+std::optional<MediaCacheEntry>
+MediaCache::lookup(const MediaCacheKey& key) const
+{
+    std::lock_guard lock{_guard};
+
+    const Id id{key.device, key.inode};
+    if (auto it = _pending.find(id); it != _pending.end()) {
+        const MediaCacheKey& stored = it->second.first;
+        if (stored.size == key.size and stored.mtime == key.mtime) {
+            return it->second.second;
+        }
+        return std::nullopt;
+    }
+
+    const Record* end = _records + _count;
+    const Record* record
+        = std::lower_bound(_records, end, id, [](const Record& item, const Id& value) {
+              return Id{item.device, item.inode} < value;
+          });
+    if (record == end or record->device != key.device or record->inode != key.inode
+        or record->size != key.size or record->mtime != key.mtime) {
+        return std::nullopt;
+    }
+
+    return MediaCacheEntry{record->probability,
+                           stringAt(record->capsOffset, record->capsLength),
+                           stringAt(record->summaryOffset, record->summaryLength)};
+}
+
+void
+MediaCache::store(const MediaCacheKey& key, MediaCacheEntry entry)
+{
+    std::lock_guard lock{_guard};
+    _pending.insert_or_assign(Id{key.device, key.inode}, std::make_pair(key, std::move(entry)));
+}
+
+std::optional<MediaCacheKey>
+MediaCache::keyOf(const std::filesystem::path& path)
+{
+    struct stat st{};
+    if (stat(path.c_str(), &st) != 0) {
+        return std::nullopt;
+    }
+    return MediaCacheKey{static_cast<guint64>(st.st_dev),
+                         static_cast<guint64>(st.st_ino),
+                         static_cast<guint64>(st.st_size),
+                         gint64{st.st_mtim.tv_sec} * G_GINT64_CONSTANT(1000000000)
+                             + st.st_mtim.tv_nsec};
+}
+
+std::string
+MediaCache::stringAt(const guint32 offset, const guint32 length) const
+{
+    if (length == 0 or gsize{offset} + length > _stringsSize) {
+        return {};
+    }
+    return std::string{_strings + offset, length};
+}
+
+void
+MediaCache::unmap()
+{
+    if (_data != nullptr) {
+        munmap(_data, _dataSize);
+    }
+    _data = nullptr;
+    _dataSize = 0;
+    _records = nullptr;
+    _count = 0;
+    _strings = nullptr;
+    _stringsSize = 0;
+}
@@ -0,0 +1,169 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/TaskPoolRegistry.hpp"
+
+namespace {
+
+constexpr const char* kDefaultClass = "default";
+
+void
+releasePool(GstTaskPool* pool)
+{
+    gst_task_pool_cleanup(pool);
+    gst_object_unref(pool);
+}
+
+} // namespace
+
+TaskPoolRegistry::TaskPoolRegistry(Factory factory)
+    : _factory{std::move(factory)}
+{
+    g_assert(_factory);
+}
+
+TaskPoolRegistry::~TaskPoolRegistry()
+{
+    std::lock_guard lock{_guard};
+    for (auto& [key, entry] : _entries) {
+        releasePool(entry.pool);
+    }
+    _entries.clear();
+}
+
+void
+TaskPoolRegistry::addClassRule(const std::string& pattern, const std::string& taskClass)
+{
+    std::lock_guard lock{_guard};
+    _rules.emplace_back(pattern, taskClass);
+}
+
+bool
+TaskPoolRegistry::parseClassRules(const gchar* rules)
+{
+    if (rules == nullptr) {
+        return true;
+    }
+
+    bool ok{true};
+    gchar** items = g_strsplit(rules, ",", -1);
+    for (gchar** item = items; *item != nullptr; ++item) {
+        gchar** parts = g_strsplit(g_strstrip(*item), "=", 2);
+        if (g_strv_length(parts) == 2 and *parts[0] != '\0' and *parts[1] != '\0') {
+            addClassRule(parts[0], parts[1]);
+        } else {
+            g_warning("Invalid pool class rule: '%s'", *item);
+            ok = false;
+        }
+        g_strfreev(parts);
+    }
+    g_strfreev(items);
+    return ok;
+}
+
+std::string
+TaskPoolRegistry::classify(const gchar* ownerPath) const
+{
+    std::lock_guard lock{_guard};
+    if (ownerPath != nullptr) {
+        for (const auto& [pattern, taskClass] : _rules) {
+            if (g_pattern_match_simple(pattern.c_str(), ownerPath)) {
+                return taskClass;
+            }
+        }
+    }
+    return kDefaultClass;
+}
+
+bool
+TaskPoolRegistry::assign(GstElement* pipeline, GstElement* owner, GstTask* task)
+{
+    g_return_val_if_fail(pipeline != nullptr, false);
+    g_return_val_if_fail(task != nullptr, false);
+
+    gchar* path = owner ? gst_object_get_path_string(GST_OBJECT(owner)) : nullptr;
+    std::string taskClass = classify(path);
+
+    std::lock_guard lock{_guard};
+    Key key{pipeline, taskClass};
+    auto entryIt = _entries.find(key);
+    if (entryIt == _entries.end()) {
+        GstTaskPool* pool = _factory(taskClass);
+        if (pool == nullptr) {
+            g_warning("Unable to create pool of '%s' class", taskClass.c_str());
+            g_free(path);
+            return false;
+        }
+        if (g_object_is_floating(pool)) {
+            gst_object_ref_sink(pool);
+        }
+        GError* error{};
+        gst_task_pool_prepare(pool, &error);
+        if (error != nullptr) {
+            g_warning(
+                "Unable to prepare pool of '%s' class: %s", taskClass.c_str(), error->message);
+            g_clear_error(&error);
+        }
+        gchar* name = gst_element_get_name(pipeline);
+        entryIt = _entries.emplace(key, Entry{pool, name, {}}).first;
+        g_free(name);
+    }
+
+    /* Task takes own reference to the pool */
+    gst_task_set_pool(task, entryIt->second.pool);
+    entryIt->second.members[task] = path ? path : "<unknown>";
+    g_free(path);
+    return true;
+}
+
+void
+TaskPoolRegistry::unassign(GstTask* task)
+{
+    std::lock_guard lock{_guard};
+    for (auto& [key, entry] : _entries) {
+        entry.members.erase(task);
+    }
+}
+
+void
+TaskPoolRegistry::release(GstElement* pipeline)
+{
+    std::lock_guard lock{_guard};
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->first.first == pipeline) {
+            releasePool(it->second.pool);
+            it = _entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+TaskPoolRegistry::dump() const
+{
+    std::lock_guard lock{_guard};
+    g_print("Task pools: %zu\n", _entries.size());
+    for (const auto& [key, entry] : _entries) {
+        g_print("  pipeline '%s', class '%s', pool %p (%s), tasks: %zu\n",
+                entry.pipelineName.c_str(),
+                key.second.c_str(),
+                entry.pool,
+                G_OBJECT_TYPE_NAME(entry.pool),
+                entry.members.size());
+        for (const auto& [task, owner] : entry.members) {
+            g_print("    task %p: %s\n", task, owner.c_str());
+        }
+    }
+}
@@ -0,0 +1,245 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/ThreadPolicy.hpp"
+
+#include <cerrno>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+std::optional<int>
+parsePolicy(const gchar* name)
+{
+    if (g_ascii_strcasecmp(name, "other") == 0) {
+        return SCHED_OTHER;
+    }
+    if (g_ascii_strcasecmp(name, "batch") == 0) {
+        return SCHED_BATCH;
+    }
+    if (g_ascii_strcasecmp(name, "idle") == 0) {
+        return SCHED_IDLE;
+    }
+    if (g_ascii_strcasecmp(name, "fifo") == 0) {
+        return SCHED_FIFO;
+    }
+    if (g_ascii_strcasecmp(name, "rr") == 0) {
+        return SCHED_RR;
+    }
+    return std::nullopt;
+}
+
+/* Parse CPU list in "0,2-3,8" format */
+bool
+parseCpus(const gchar* list, std::vector<int>& cpus)
+{
+    bool ok{true};
+    gchar** items = g_strsplit(list, ",", -1);
+    for (gchar** item = items; ok and *item != nullptr; ++item) {
+        gchar** range = g_strsplit(g_strstrip(*item), "-", 2);
+        guint64 first{}, last{};
+        ok = g_ascii_string_to_unsigned(range[0], 10, 0, CPU_SETSIZE - 1, &first, nullptr);
+        if (ok) {
+            last = first;
+            if (range[1] != nullptr) {
+                ok = g_ascii_string_to_unsigned(
+                    range[1], 10, first, CPU_SETSIZE - 1, &last, nullptr);
+            }
+        }
+        for (guint64 cpu = first; ok and cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        g_strfreev(range);
+    }
+    g_strfreev(items);
+    return ok;
+}
+
+} // namespace
+
+bool
+ThreadPolicyMap::load(const std::filesystem::path& path, GError** error)
+{
+    GKeyFile* file = g_key_file_new();
+    if (not g_key_file_load_from_file(file, path.c_str(), G_KEY_FILE_NONE, error)) {
+        g_key_file_free(file);
+        return false;
+    }
+
+    std::vector<ThreadPolicy> policies;
+    bool ok{true};
+    gchar** groups = g_key_file_get_groups(file, nullptr);
+    for (gchar** group = groups; ok and *group != nullptr; ++group) {
+        ThreadPolicy policy;
+        policy.name = *group;
+
+        gchar* match = g_key_file_get_string(file, *group, "match", error);
+        if (match == nullptr) {
+            ok = false;
+            break;
+        }
+        policy.pattern = match;
+        g_free(match);
+
+        if (gchar* cpus = g_key_file_get_string(file, *group, "cpus", nullptr); cpus) {
+            ok = parseCpus(cpus, policy.cpus);
+            if (not ok) {
+                g_set_error(error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Invalid CPU list '%s' in '%s'",
+                            cpus,
+                            *group);
+            }
+            g_free(cpus);
+        }
+
+        if (gchar* name = g_key_file_get_string(file, *group, "policy", nullptr); name) {
+            policy.policy = parsePolicy(name);
+            if (ok and not policy.policy) {
+                g_set_error(error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Unknown policy '%s' in '%s'",
+                            name,
+                            *group);
+                ok = false;
+            }
+            g_free(name);
+        }
+
+        /* Real-time policies need a priority in their range, others take 0 only */
+        const gboolean realtime
+            = policy.policy and (*policy.policy == SCHED_FIFO or *policy.policy == SCHED_RR);
+        if (ok and (realtime or g_key_file_has_key(file, *group, "priority", nullptr))) {
+            const int min = realtime ? sched_get_priority_min(*policy.policy) : 0;
+            const int max = realtime ? sched_get_priority_max(*policy.policy) : 0;
+            GError* intError{};
+            policy.priority = g_key_file_get_integer(file, *group, "priority", &intError);
+            if (intError != nullptr or policy.priority < min or policy.priority > max) {
+                g_set_error(error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Priority of '%s' must be in %d..%d range",
+                            *group,
+                            min,
+                            max);
+                g_clear_error(&intError);
+                ok = false;
+            }
+        }
+        if (ok and g_key_file_has_key(file, *group, "nice", nullptr)) {
+            GError* intError{};
+            policy.nice = g_key_file_get_integer(file, *group, "nice", &intError);
+            if (intError != nullptr or *policy.nice < -20 or *policy.nice > 19) {
+                g_set_error(error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Nice of '%s' must be in -20..19 range",
+                            *group);
+                g_clear_error(&intError);
+                ok = false;
+            }
+        }
+
+        if (ok) {
+            policies.push_back(std::move(policy));
+        }
+    }
+    g_strfreev(groups);
+    g_key_file_free(file);
+
+    if (ok) {
+        _policies = std::move(policies);
+    }
+    return ok;
+}
+
+bool
+ThreadPolicyMap::empty() const
+{
+    return _policies.empty();
+}
+
+const ThreadPolicy*
+ThreadPolicyMap::find(const gchar* elementPath) const
+{
+    if (elementPath == nullptr) {
+        return nullptr;
+    }
+    for (const auto& policy : _policies) {
+        if (g_pattern_match_simple(policy.pattern.c_str(), elementPath)) {
+            return &policy;
+        }
+    }
+    return nullptr;
+}
+
+bool
+ThreadPolicyMap::applyFor(const gchar* elementPath) const
+{
+    if (const ThreadPolicy* policy = find(elementPath); policy != nullptr) {
+        g_message("Apply '%s' policy to '%s'", policy->name.c_str(), elementPath);
+        return apply(*policy);
+    }
+    return false;
+}
+
+bool
+ThreadPolicyMap::apply(const ThreadPolicy& policy)
+{
+    bool ok{true};
+
+    if (not policy.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : policy.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        if (const int rv = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rv != 0) {
+            g_warning("Policy '%s': set affinity has failed, %s",
+                      policy.name.c_str(),
+                      g_strerror(rv));
+            ok = false;
+        }
+    }
+
+    if (policy.policy) {
+        sched_param param{};
+        param.sched_priority = policy.priority;
+        if (const int rv = pthread_setschedparam(pthread_self(), *policy.policy, &param); rv != 0) {
+            g_warning("Policy '%s': set scheduling has failed, %s",
+                      policy.name.c_str(),
+                      g_strerror(rv));
+            ok = false;
+        }
+    }
+
+    if (policy.nice) {
+        /* On Linux the nice value is per-thread when addressed by TID */
+        const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+        if (setpriority(PRIO_PROCESS, tid, *policy.nice) != 0) {
+            g_warning(
+                "Policy '%s': set nice has failed, %s", policy.name.c_str(), g_strerror(errno));
+            ok = false;
+        }
+    }
+
+    return ok;
+}
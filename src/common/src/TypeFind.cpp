@@ -0,0 +1,166 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/TypeFind.hpp"
+
+#include <gst/base/gsttypefindhelper.h>
+
+#include <optional>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TypeFinder::TypeFinder(const GstClockTime timeout)
+    : _timeout{timeout}
+{
+    _pipeline = gst_pipeline_new(nullptr);
+    g_assert(_pipeline);
+    _src = gst_element_factory_make("filesrc", nullptr);
+    g_assert(_src);
+    GstElement* typefind = gst_element_factory_make("typefind", nullptr);
+    g_assert(typefind);
+    GstElement* sink = gst_element_factory_make("fakesink", nullptr);
+    g_assert(sink);
+
+    g_signal_connect(typefind, "have-type", G_CALLBACK(onHaveType), this);
+    gst_bin_add_many(GST_BIN(_pipeline), _src, typefind, sink, NULL);
+    gst_element_link_many(_src, typefind, sink, NULL);
+}
+
+TypeFinder::~TypeFinder()
+{
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    gst_caps_replace(&_caps, nullptr);
+    gst_object_unref(_pipeline);
+}
+
+GstCaps*
+TypeFinder::find(const std::filesystem::path& path, GstTypeFindProbability* probability)
+{
+    GstBus* bus = gst_element_get_bus(_pipeline);
+
+    /* Location may be changed in READY state only, drop messages of previous file */
+    gst_element_set_state(_pipeline, GST_STATE_READY);
+    gst_bus_set_flushing(bus, TRUE);
+    gst_bus_set_flushing(bus, FALSE);
+    gst_caps_replace(&_caps, nullptr);
+    _probability = GST_TYPE_FIND_NONE;
+    g_object_set(_src, "location", path.c_str(), NULL);
+
+    /* The type is found before the sink prerolls */
+    gst_element_set_state(_pipeline, GST_STATE_PAUSED);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus, _timeout, GstMessageType(GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR));
+    if (msg != nullptr) {
+        gst_message_unref(msg);
+    } else {
+        /* File never prerolls, streaming is stopped before the result is dropped */
+        g_message("Typefinding %s timed out", path.c_str());
+        gst_element_set_state(_pipeline, GST_STATE_READY);
+        gst_caps_replace(&_caps, nullptr);
+        _probability = GST_TYPE_FIND_NONE;
+    }
+    gst_object_unref(bus);
+
+    if (probability != nullptr) {
+        *probability = static_cast<GstTypeFindProbability>(_probability);
+    }
+    return std::exchange(_caps, nullptr);
+}
+
+void
+TypeFinder::onHaveType(GstElement* /*typefind*/, guint probability, GstCaps* caps, gpointer data)
+{
+    auto* self = static_cast<TypeFinder*>(data);
+    gst_caps_replace(&self->_caps, caps);
+    self->_probability = probability;
+}
+
+GstCaps*
+typeFindFileHeader(const std::filesystem::path& path,
+                   GstTypeFindProbability* probability,
+                   gsize headerSize)
+{
+    if (probability != nullptr) {
+        *probability = GST_TYPE_FIND_NONE;
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 or st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    /* Only the header is mapped, the rest of the file is never touched */
+    const gsize size = MIN(headerSize, static_cast<gsize>(st.st_size));
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(data, size, MADV_WILLNEED);
+
+    gchar* extension{};
+    if (path.has_extension()) {
+        extension = g_ascii_strdown(path.extension().c_str() + 1, -1);
+    }
+    GstCaps* caps = gst_type_find_helper_for_data_with_extension(
+        nullptr, static_cast<const guint8*>(data), size, extension, probability);
+    g_free(extension);
+    munmap(data, size);
+    return caps;
+}
+
+GstCaps*
+typeFindFile(const std::filesystem::path& path,
+             GstTypeFindProbability* probability,
+             TypeFinder* finder)
+{
+    GstTypeFindProbability headerProbability{GST_TYPE_FIND_NONE};
+    GstCaps* caps = typeFindFileHeader(path, &headerProbability);
+    if (caps != nullptr and headerProbability >= GST_TYPE_FIND_LIKELY) {
+        if (probability != nullptr) {
+            *probability = headerProbability;
+        }
+        return caps;
+    }
+
+    /* Inconclusive, let typefind element see the whole stream */
+    std::optional<TypeFinder> ownFinder;
+    if (finder == nullptr) {
+        finder = &ownFinder.emplace();
+    }
+    GstTypeFindProbability pipelineProbability{GST_TYPE_FIND_NONE};
+    GstCaps* pipelineCaps = finder->find(path, &pipelineProbability);
+    if (pipelineCaps != nullptr and pipelineProbability >= headerProbability) {
+        gst_caps_replace(&caps, nullptr);
+        caps = pipelineCaps;
+        headerProbability = pipelineProbability;
+    } else if (pipelineCaps != nullptr) {
+        gst_caps_unref(pipelineCaps);
+    }
+
+    if (probability != nullptr) {
+        *probability = headerProbability;
+    }
+    return caps;
+}
@@ -248,3 +248,42 @@ printPadTemplatesInfo(GstElementFactory* factory)
         g_print("\n");
     }
 }
+
+GPtrArray*
+readUriList(const gchar* path)
+{
+    gchar* contents{};
+    GError* error{};
+    if (not g_file_get_contents(path, &contents, nullptr, &error)) {
+        g_printerr("Unable to read URI list: %s\n", error->message);
+        g_clear_error(&error);
+        return nullptr;
+    }
+
+    GPtrArray* uris = g_ptr_array_new_with_free_func(g_free);
+    gchar** lines = g_strsplit(contents, "\n", -1);
+    for (gchar** line = lines; *line != nullptr; ++line) {
+        const gchar* item = g_strstrip(*line);
+        if (*item == '\0' or *item == '#') {
+            continue;
+        }
+        gchar* uri{};
+        if (gst_uri_is_valid(item)) {
+            uri = g_strdup(item);
+        } else if (uri = gst_filename_to_uri(item, &error); not uri) {
+            g_printerr("Skipping '%s': %s\n", item, error->message);
+            g_clear_error(&error);
+            continue;
+        }
+        g_ptr_array_add(uris, uri);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+
+    if (uris->len == 0) {
+        g_printerr("No URIs in %s\n", path);
+        g_ptr_array_unref(uris);
+        return nullptr;
+    }
+    return uris;
+}
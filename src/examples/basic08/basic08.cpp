@@ -12,20 +12,81 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "common/DiscovererIndex.hpp"
+#include "common/JsonWriter.hpp"
+#include "common/MediaCache.hpp"
+#include "common/Utils.hpp"
+
 #include <gst/gst.h>
 #include <gst/pbutils/pbutils.h>
 
-#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
-using namespace std;
+/**
+ * Example 8: Discovering media information
+ *  + persistent cache: summary of unchanged local file is printed without discovering
+ *  + batch mode: URI list is discovered by a pool of discoverers with retries
+ *  + serialized index: info of unchanged local file is restored without discovering
+ *  + fast profile: brief description and adaptive timeout in batch mode
+ *  + NDJSON output: one record per URI streamed through a buffered writer
+ */
 
 static GstDiscoverer* discoverer{};
 static GMainLoop* loop{};
+static gchar* cachePath{};
+static gchar* batchList{};
+static gint jobs{};
+static gint retries{2};
+static gint timeout{5};
+static gchar* profile{};
+static gboolean bench{};
+static MediaCache* cache{};
+static gchar* indexPath{};
+static DiscovererIndex* discoveryIndex{};
+static gboolean jsonOutput{};
+static JsonWriter* json{};
 
-/* Print a tag in a human-readable format (name: value) */
+/* Returns the size of binary tag value (cover art, attachment), nullopt for other values */
+static std::optional<gsize>
+binaryTagSize(const GValue* val)
+{
+    const GType type = G_VALUE_TYPE(val);
+    if (type != GST_TYPE_SAMPLE and type != GST_TYPE_BUFFER) {
+        return std::nullopt;
+    }
+    GstBuffer* buffer{};
+    if (type == GST_TYPE_SAMPLE) {
+        if (GstSample* sample = gst_value_get_sample(val); sample) {
+            buffer = gst_sample_get_buffer(sample);
+        }
+    } else {
+        buffer = gst_value_get_buffer(val);
+    }
+    return buffer ? gst_buffer_get_size(buffer) : 0;
+}
+
+/* Append a tag in a human-readable format (name: value), binary values by size only */
 static void
-printTagForeach(const GstTagList* tags, const gchar* tag, gpointer user_data)
+printTagForeach(const GstTagList* tags, const gchar* tag, gpointer data)
 {
+    auto* out = static_cast<std::pair<GString*, gint>*>(data);
+
+    if (binaryTagSize(gst_tag_list_get_value_index(tags, tag, 0))) {
+        g_string_append_printf(out->first, "%*s%s:", 2 * out->second, " ", gst_tag_get_nick(tag));
+        const guint count = gst_tag_list_get_tag_size(tags, tag);
+        for (guint n = 0; n < count; ++n) {
+            const auto size = binaryTagSize(gst_tag_list_get_value_index(tags, tag, n));
+            g_string_append_printf(
+                out->first, "%s %" G_GSIZE_FORMAT " bytes", n > 0 ? "," : "", size.value_or(0));
+        }
+        g_string_append_c(out->first, '\n');
+        return;
+    }
+
     GValue val{};
     gst_tag_list_copy_value(&val, tags, tag);
 
@@ -36,16 +97,23 @@ printTagForeach(const GstTagList* tags, const gchar* tag, gpointer user_data)
         str = gst_value_serialize(&val);
     }
 
-    const gint depth = GPOINTER_TO_INT(user_data);
-    g_print("%*s%s: %s\n", 2 * depth, " ", gst_tag_get_nick(tag), str);
+    g_string_append_printf(
+        out->first, "%*s%s: %s\n", 2 * out->second, " ", gst_tag_get_nick(tag), str);
     g_free(str);
 
     g_value_unset(&val);
 }
 
-/* Print information regarding a stream */
 static void
-printStreamInfo(GstDiscovererStreamInfo* info, const gint depth)
+printTags(GString* out, const GstTagList* tags, const gint depth)
+{
+    std::pair<GString*, gint> data{out, depth};
+    gst_tag_list_foreach(tags, printTagForeach, &data);
+}
+
+/* Append information regarding a stream */
+static void
+printStreamInfo(GString* out, GstDiscovererStreamInfo* info, const gint depth)
 {
     gchar* desc = nullptr;
     if (GstCaps* caps = gst_discoverer_stream_info_get_caps(info); caps) {
@@ -57,36 +125,37 @@ printStreamInfo(GstDiscovererStreamInfo* info, const gint depth)
         gst_caps_unref(caps);
     }
 
-    g_print("%*s%s: %s\n",
-            2 * depth,
-            " ",
-            gst_discoverer_stream_info_get_stream_type_nick(info),
-            (desc ? desc : ""));
+    g_string_append_printf(out,
+                           "%*s%s: %s\n",
+                           2 * depth,
+                           " ",
+                           gst_discoverer_stream_info_get_stream_type_nick(info),
+                           (desc ? desc : ""));
     if (desc) {
         g_free(desc);
         desc = nullptr;
     }
 
     if (const GstTagList* tags = gst_discoverer_stream_info_get_tags(info); tags) {
-        g_print("%*sTags:\n", 2 * (depth + 1), " ");
-        gst_tag_list_foreach(tags, printTagForeach, GINT_TO_POINTER(depth + 2));
+        g_string_append_printf(out, "%*sTags:\n", 2 * (depth + 1), " ");
+        printTags(out, tags, depth + 2);
     }
 }
 
-/* Print information regarding a stream and its substreams, if any */
+/* Append information regarding a stream and its substreams, if any */
 static void
-printTopology(GstDiscovererStreamInfo* info, gint depth)
+printTopology(GString* out, GstDiscovererStreamInfo* info, gint depth)
 {
     GstDiscovererStreamInfo* next;
 
     if (!info)
         return;
 
-    printStreamInfo(info, depth);
+    printStreamInfo(out, info, depth);
 
     next = gst_discoverer_stream_info_get_next(info);
     if (next) {
-        printTopology(next, depth + 1);
+        printTopology(out, next, depth + 1);
         gst_discoverer_stream_info_unref(next);
     } else if (GST_IS_DISCOVERER_CONTAINER_INFO(info)) {
         GList *tmp, *streams;
@@ -94,12 +163,302 @@ printTopology(GstDiscovererStreamInfo* info, gint depth)
         streams = gst_discoverer_container_info_get_streams(GST_DISCOVERER_CONTAINER_INFO(info));
         for (tmp = streams; tmp; tmp = tmp->next) {
             GstDiscovererStreamInfo* tmpinf = (GstDiscovererStreamInfo*) tmp->data;
-            printTopology(tmpinf, depth + 1);
+            printTopology(out, tmpinf, depth + 1);
         }
         gst_discoverer_stream_info_list_free(streams);
     }
 }
 
+/* Returns the key of local file URI to consult the cache with */
+static std::optional<MediaCacheKey>
+cacheKeyOf(const gchar* uri)
+{
+    std::optional<MediaCacheKey> key;
+    if (cache == nullptr) {
+        return key;
+    }
+    if (gchar* path = g_filename_from_uri(uri, nullptr, nullptr); path) {
+        key = MediaCache::keyOf(path);
+        g_free(path);
+    }
+    return key;
+}
+
+static void
+storeCached(const gchar* uri, MediaCacheEntry entry)
+{
+    if (const auto key = cacheKeyOf(uri); key) {
+        cache->store(*key, std::move(entry));
+    }
+}
+
+/**
+ * Returns indexed info of unchanged local file (unref after usage) or nullptr. Records of
+ * the fast profile don't keep tags and misc, they satisfy the fast profile only.
+ */
+static GstDiscovererInfo*
+lookupIndexed(const gchar* uri,
+              const GstDiscovererSerializeFlags required = GST_DISCOVERER_SERIALIZE_ALL)
+{
+    if (discoveryIndex == nullptr) {
+        return nullptr;
+    }
+    const auto mtime = DiscovererIndex::mtimeOf(uri);
+    return mtime ? discoveryIndex->lookup(uri, *mtime, required) : nullptr;
+}
+
+/* Remote URIs have no mtime and are not indexed */
+static void
+appendIndexed(GstDiscovererInfo* info,
+              const GstDiscovererSerializeFlags flags = GST_DISCOVERER_SERIALIZE_ALL)
+{
+    if (discoveryIndex == nullptr) {
+        return;
+    }
+    const auto mtime = DiscovererIndex::mtimeOf(gst_discoverer_info_get_uri(info));
+    if (not mtime) {
+        return;
+    }
+    GError* error{};
+    if (not discoveryIndex->append(info, *mtime, &error, flags)) {
+        g_printerr("Unable to index: %s\n", error->message);
+        g_clear_error(&error);
+    }
+}
+
+/* Returns caps of the top-level stream and the report of discovered information */
+static MediaCacheEntry
+describeInfo(GstDiscovererInfo* info)
+{
+    GString* out = g_string_new(nullptr);
+
+    g_string_append_printf(out,
+                           "\nDuration: %" GST_TIME_FORMAT "\n",
+                           GST_TIME_ARGS(gst_discoverer_info_get_duration(info)));
+
+    const GstTagList* tags = gst_discoverer_info_get_tags(info);
+    if (tags) {
+        g_string_append(out, "Tags:\n");
+        printTags(out, tags, 1);
+    }
+    g_string_append_printf(
+        out, "Seekable: %s\n", (gst_discoverer_info_get_seekable(info) ? "yes" : "no"));
+    g_string_append(out, "\n");
+
+    MediaCacheEntry entry{GST_TYPE_FIND_MAXIMUM};
+    if (GstDiscovererStreamInfo* sinfo = gst_discoverer_info_get_stream_info(info); sinfo) {
+        g_string_append(out, "Stream information:\n");
+        printTopology(out, sinfo, 1);
+        g_string_append(out, "\n");
+
+        if (GstCaps* caps = gst_discoverer_stream_info_get_caps(sinfo); caps) {
+            gchar* str = gst_caps_to_string(caps);
+            entry.caps = str;
+            g_free(str);
+            gst_caps_unref(caps);
+        }
+        gst_discoverer_stream_info_unref(sinfo);
+    }
+
+    entry.summary = out->str;
+    g_string_free(out, TRUE);
+    return entry;
+}
+
+/* The report is built only if there is a cache to keep it in */
+static void
+storeDescribed(const gchar* uri, GstDiscovererInfo* info)
+{
+    if (const auto key = cacheKeyOf(uri); key) {
+        cache->store(*key, describeInfo(info));
+    }
+}
+
+static const gchar*
+resultName(const GstDiscovererResult result)
+{
+    switch (result) {
+    case GST_DISCOVERER_OK:
+        return "ok";
+    case GST_DISCOVERER_URI_INVALID:
+        return "invalid-uri";
+    case GST_DISCOVERER_ERROR:
+        return "error";
+    case GST_DISCOVERER_TIMEOUT:
+        return "timeout";
+    case GST_DISCOVERER_BUSY:
+        return "busy";
+    case GST_DISCOVERER_MISSING_PLUGINS:
+        return "missing-plugins";
+    }
+    return "unknown";
+}
+
+/* Write a tag value, binary values (images, attachments) are written as their size only */
+static void
+writeTagValue(JsonWriter& out, const GValue* val)
+{
+    const GType type = G_VALUE_TYPE(val);
+    if (G_VALUE_HOLDS_STRING(val)) {
+        out.value(g_value_get_string(val));
+    } else if (type == G_TYPE_UINT) {
+        out.value(g_value_get_uint(val));
+    } else if (type == G_TYPE_INT) {
+        out.value(g_value_get_int(val));
+    } else if (type == G_TYPE_UINT64) {
+        out.value(guint64{g_value_get_uint64(val)});
+    } else if (type == G_TYPE_INT64) {
+        out.value(gint64{g_value_get_int64(val)});
+    } else if (type == G_TYPE_DOUBLE) {
+        out.value(g_value_get_double(val));
+    } else if (type == G_TYPE_FLOAT) {
+        out.value(gdouble{g_value_get_float(val)});
+    } else if (type == G_TYPE_BOOLEAN) {
+        out.value(bool(g_value_get_boolean(val)));
+    } else if (const auto size = binaryTagSize(val); size) {
+        out.beginObject().key("size").value(static_cast<guint64>(*size)).endObject();
+    } else {
+        gchar* str = gst_value_serialize(val);
+        out.value(str);
+        g_free(str);
+    }
+}
+
+/* Values are read in place, multi-value tags are written as arrays */
+static void
+writeTags(JsonWriter& out, const GstTagList* tags)
+{
+    out.beginObject();
+    const gint count = gst_tag_list_n_tags(tags);
+    for (gint i = 0; i < count; ++i) {
+        const gchar* tag = gst_tag_list_nth_tag_name(tags, i);
+        const guint size = gst_tag_list_get_tag_size(tags, tag);
+        out.key(tag);
+        if (size == 1) {
+            writeTagValue(out, gst_tag_list_get_value_index(tags, tag, 0));
+            continue;
+        }
+        out.beginArray();
+        for (guint n = 0; n < size; ++n) {
+            writeTagValue(out, gst_tag_list_get_value_index(tags, tag, n));
+        }
+        out.endArray();
+    }
+    out.endObject();
+}
+
+/* Write a stream and its substreams, if any */
+static void
+writeStream(JsonWriter& out, GstDiscovererStreamInfo* info)
+{
+    out.beginObject();
+    out.key("type").value(gst_discoverer_stream_info_get_stream_type_nick(info));
+    if (GstCaps* caps = gst_discoverer_stream_info_get_caps(info); caps) {
+        gchar* str = gst_caps_to_string(caps);
+        out.key("caps").value(str);
+        g_free(str);
+        gst_caps_unref(caps);
+    }
+
+    if (GST_IS_DISCOVERER_VIDEO_INFO(info)) {
+        auto* video = GST_DISCOVERER_VIDEO_INFO(info);
+        out.key("width").value(gst_discoverer_video_info_get_width(video));
+        out.key("height").value(gst_discoverer_video_info_get_height(video));
+        out.key("framerate")
+            .beginArray()
+            .value(gst_discoverer_video_info_get_framerate_num(video))
+            .value(gst_discoverer_video_info_get_framerate_denom(video))
+            .endArray();
+        out.key("bitrate").value(gst_discoverer_video_info_get_bitrate(video));
+        out.key("interlaced").value(bool(gst_discoverer_video_info_is_interlaced(video)));
+        out.key("image").value(bool(gst_discoverer_video_info_is_image(video)));
+    } else if (GST_IS_DISCOVERER_AUDIO_INFO(info)) {
+        auto* audio = GST_DISCOVERER_AUDIO_INFO(info);
+        out.key("channels").value(gst_discoverer_audio_info_get_channels(audio));
+        out.key("sample-rate").value(gst_discoverer_audio_info_get_sample_rate(audio));
+        out.key("depth").value(gst_discoverer_audio_info_get_depth(audio));
+        out.key("bitrate").value(gst_discoverer_audio_info_get_bitrate(audio));
+        out.key("language").value(gst_discoverer_audio_info_get_language(audio));
+    } else if (GST_IS_DISCOVERER_SUBTITLE_INFO(info)) {
+        auto* subtitle = GST_DISCOVERER_SUBTITLE_INFO(info);
+        out.key("language").value(gst_discoverer_subtitle_info_get_language(subtitle));
+    }
+
+    if (const GstTagList* tags = gst_discoverer_stream_info_get_tags(info); tags) {
+        out.key("tags");
+        writeTags(out, tags);
+    }
+
+    if (GstDiscovererStreamInfo* next = gst_discoverer_stream_info_get_next(info); next) {
+        out.key("streams").beginArray();
+        writeStream(out, next);
+        out.endArray();
+        gst_discoverer_stream_info_unref(next);
+    } else if (GST_IS_DISCOVERER_CONTAINER_INFO(info)) {
+        GList* streams
+            = gst_discoverer_container_info_get_streams(GST_DISCOVERER_CONTAINER_INFO(info));
+        out.key("streams").beginArray();
+        for (GList* item = streams; item != nullptr; item = item->next) {
+            writeStream(out, static_cast<GstDiscovererStreamInfo*>(item->data));
+        }
+        out.endArray();
+        gst_discoverer_stream_info_list_free(streams);
+    }
+    out.endObject();
+}
+
+/* Write one record with the result of URI discovery */
+static void
+writeInfo(JsonWriter& out, GstDiscovererInfo* info, const GError* err)
+{
+    const GstDiscovererResult result = gst_discoverer_info_get_result(info);
+
+    out.beginObject();
+    out.key("uri").value(gst_discoverer_info_get_uri(info));
+    out.key("result").value(resultName(result));
+    if (err != nullptr) {
+        out.key("error").value(err->message);
+    }
+    if (result == GST_DISCOVERER_MISSING_PLUGINS) {
+        out.key("missing").beginArray();
+        const gchar** details = gst_discoverer_info_get_missing_elements_installer_details(info);
+        for (const gchar** detail = details; detail and *detail; ++detail) {
+            out.value(*detail);
+        }
+        out.endArray();
+    }
+    if (result == GST_DISCOVERER_OK) {
+        out.key("duration").value(guint64{gst_discoverer_info_get_duration(info)});
+        out.key("seekable").value(bool(gst_discoverer_info_get_seekable(info)));
+        out.key("live").value(bool(gst_discoverer_info_get_live(info)));
+        if (const GstTagList* tags = gst_discoverer_info_get_tags(info); tags) {
+            out.key("tags");
+            writeTags(out, tags);
+        }
+        if (GstDiscovererStreamInfo* sinfo = gst_discoverer_info_get_stream_info(info); sinfo) {
+            out.key("stream");
+            writeStream(out, sinfo);
+            gst_discoverer_stream_info_unref(sinfo);
+        }
+    }
+    out.endObject();
+    out.endRecord();
+}
+
+/* Write one record for URI that was not discovered in this run */
+static void
+writeStatus(JsonWriter& out, const gchar* uri, const gchar* result, const gchar* error)
+{
+    out.beginObject();
+    out.key("uri").value(uri);
+    out.key("result").value(result);
+    if (error != nullptr) {
+        out.key("error").value(error);
+    }
+    out.endObject();
+    out.endRecord();
+}
+
 /* This function is called every time the discoverer has information regarding
  * one of the URIs we provided.*/
 static void
@@ -107,6 +466,15 @@ onDiscovered(GstDiscoverer* discoverer, GstDiscovererInfo* info, GError* err)
 {
     const gchar* uri = gst_discoverer_info_get_uri(info);
     GstDiscovererResult result = gst_discoverer_info_get_result(info);
+    if (json != nullptr) {
+        writeInfo(*json, info, err);
+        if (result == GST_DISCOVERER_OK) {
+            storeDescribed(uri, info);
+            appendIndexed(info);
+        }
+        return;
+    }
+
     switch (result) {
     case GST_DISCOVERER_URI_INVALID:
         g_print("Invalid URI '%s'\n", uri);
@@ -142,54 +510,566 @@ onDiscovered(GstDiscoverer* discoverer, GstDiscovererInfo* info, GError* err)
     }
 
     /* If we got no error, show the retrieved information */
+    MediaCacheEntry entry = describeInfo(info);
+    g_print("%s", entry.summary.c_str());
+    storeCached(uri, std::move(entry));
+    appendIndexed(info);
+}
+
+/* This function is called when the discoverer has finished examining
+ * all the URIs we provided.*/
+static void
+on_finished_cb(GstDiscoverer* /*discoverer*/)
+{
+    if (json == nullptr) {
+        g_print("Finished discovering\n");
+    }
+    g_main_loop_quit(loop);
+}
 
-    g_print("\nDuration: %" GST_TIME_FORMAT "\n",
-            GST_TIME_ARGS(gst_discoverer_info_get_duration(info)));
+/* Returns TRUE if the summary of URI has been printed from the index or the cache */
+static gboolean
+printCached(const gchar* uri)
+{
+    if (GstDiscovererInfo* info = lookupIndexed(uri); info) {
+        if (json != nullptr) {
+            writeInfo(*json, info, nullptr);
+        } else {
+            g_print("Discovered '%s' (indexed)\n%s", uri, describeInfo(info).summary.c_str());
+        }
+        gst_discoverer_info_unref(info);
+        return TRUE;
+    }
 
-    const GstTagList* tags = gst_discoverer_info_get_tags(info);
-    if (tags) {
-        g_print("Tags:\n");
-        gst_tag_list_foreach(tags, printTagForeach, GINT_TO_POINTER(1));
+    /* Text summary has nothing to fill JSON record with, the URI is discovered again */
+    if (json != nullptr) {
+        return FALSE;
+    }
+    const auto key = cacheKeyOf(uri);
+    if (not key) {
+        return FALSE;
     }
-    g_print("Seekable: %s\n", (gst_discoverer_info_get_seekable(info) ? "yes" : "no"));
-    g_print("\n");
+    const auto entry = cache->lookup(*key);
+    if (not entry or entry->summary.empty()) {
+        return FALSE;
+    }
+    g_print("Discovered '%s' (cached)\n%s", uri, entry->summary.c_str());
+    return TRUE;
+}
 
-    GstDiscovererStreamInfo* sinfo = gst_discoverer_info_get_stream_info(info);
-    if (!sinfo) {
+static void
+saveCache()
+{
+    if (cache == nullptr) {
         return;
     }
-    g_print("Stream information:\n");
-    printTopology(sinfo, 1);
-    g_print("\n");
+    GError* error{};
+    if (not cache->flush(&error)) {
+        g_printerr("Unable to save cache: %s\n", error->message);
+        g_clear_error(&error);
+    }
+}
+
+/* URI waiting for discovery and the number of attempts made */
+struct BatchJob {
+    gchar* uri{};
+    gint attempts{};
+    gint64 submitted{};
+};
+
+struct Batch;
 
-    gst_discoverer_stream_info_unref(sinfo);
+/* Discoverer of the pool, it is given one URI at a time to balance the load */
+struct BatchWorker {
+    Batch* batch{};
+    GstDiscoverer* discoverer{};
+    BatchJob* job{};
+};
+
+/**
+ * Full profile keeps everything the discoverer collects. Fast profile keeps container,
+ * codecs, duration and resolution only and limits discovery time by recent history.
+ */
+enum class Profile { Full, Fast };
+
+struct Batch {
+    Profile profile{Profile::Full};
+    gboolean print{TRUE};
+    GQueue jobs = G_QUEUE_INIT;
+    std::vector<std::unique_ptr<BatchWorker>> workers;
+    guint total{};
+    guint succeeded{};
+    guint cached{};
+    guint failed{};
+    guint retried{};
+    guint timedOut{};
+    guint active{};
+    gdouble meanTime{}; /* EWMA of successful discovery time (s) */
+    guint samples{};
+    gdouble seconds{};
+};
+
+/* Adaptive timeout: multiple of the recent discovery time, bounded by --timeout */
+static constexpr gdouble kTimeoutFactor = 4.0;
+static constexpr gdouble kTimeoutMin = 0.5;
+static constexpr gdouble kTimeoutSmoothing = 0.2;
+static constexpr guint kTimeoutWarmup = 8;
+
+static void
+freeBatchJob(BatchJob* job)
+{
+    g_free(job->uri);
+    delete job;
+}
+
+static const gchar*
+profileName(const Profile profile)
+{
+    return profile == Profile::Fast ? "fast" : "full";
+}
+
+/* Container, codecs with resolution of video streams in one line */
+static std::string
+describeBrief(GstDiscovererInfo* info)
+{
+    GString* out = g_string_new(nullptr);
+
+    if (GstDiscovererStreamInfo* sinfo = gst_discoverer_info_get_stream_info(info); sinfo) {
+        if (GST_IS_DISCOVERER_CONTAINER_INFO(sinfo)) {
+            if (GstCaps* caps = gst_discoverer_stream_info_get_caps(sinfo); caps) {
+                g_string_append(out, gst_structure_get_name(gst_caps_get_structure(caps, 0)));
+                gst_caps_unref(caps);
+            }
+        }
+        gst_discoverer_stream_info_unref(sinfo);
+    }
+
+    GList* streams = gst_discoverer_info_get_stream_list(info);
+    for (GList* item = streams; item != nullptr; item = item->next) {
+        auto* stream = static_cast<GstDiscovererStreamInfo*>(item->data);
+        if (GST_IS_DISCOVERER_CONTAINER_INFO(stream)) {
+            continue;
+        }
+        GstCaps* caps = gst_discoverer_stream_info_get_caps(stream);
+        if (caps == nullptr) {
+            continue;
+        }
+        gchar* desc = gst_caps_is_fixed(caps) ? gst_pb_utils_get_codec_description(caps)
+                                              : nullptr;
+        const gchar* name = desc ? desc : gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        g_string_append_printf(out, "%s%s", out->len > 0 ? ", " : "", name);
+        g_free(desc);
+        gst_caps_unref(caps);
+
+        if (GST_IS_DISCOVERER_VIDEO_INFO(stream)) {
+            auto* video = GST_DISCOVERER_VIDEO_INFO(stream);
+            g_string_append_printf(out,
+                                   " %ux%u",
+                                   gst_discoverer_video_info_get_width(video),
+                                   gst_discoverer_video_info_get_height(video));
+        }
+    }
+    gst_discoverer_stream_info_list_free(streams);
+
+    std::string brief{out->str};
+    g_string_free(out, TRUE);
+    return brief;
+}
+
+static GstClockTime
+batchTimeout(const Batch& batch, const BatchJob& job)
+{
+    /* Retried URI gets the full timeout, it may be slow but valid */
+    if (batch.profile == Profile::Full or job.attempts > 1 or batch.samples < kTimeoutWarmup) {
+        return timeout * GST_SECOND;
+    }
+    const gdouble seconds = CLAMP(batch.meanTime * kTimeoutFactor, kTimeoutMin, gdouble(timeout));
+    return static_cast<GstClockTime>(seconds * GST_SECOND);
+}
+
+/* Hand the next URI to the worker, called from idle so the discoverer is never re-entered */
+static gboolean
+onBatchSubmit(gpointer data)
+{
+    auto* worker = static_cast<BatchWorker*>(data);
+    Batch* batch = worker->batch;
+
+    while (auto* job = static_cast<BatchJob*>(g_queue_pop_head(&batch->jobs))) {
+        const GstDiscovererSerializeFlags required = batch->profile == Profile::Fast
+                                                         ? GST_DISCOVERER_SERIALIZE_CAPS
+                                                         : GST_DISCOVERER_SERIALIZE_ALL;
+        if (GstDiscovererInfo* info = lookupIndexed(job->uri, required); info) {
+            if (json != nullptr) {
+                writeInfo(*json, info, nullptr);
+            } else {
+                g_print("%s\tok\t%" GST_TIME_FORMAT "\tindexed\n",
+                        job->uri,
+                        GST_TIME_ARGS(gst_discoverer_info_get_duration(info)));
+            }
+            gst_discoverer_info_unref(info);
+            batch->cached++;
+            freeBatchJob(job);
+            continue;
+        }
+        if (const auto key = json == nullptr ? cacheKeyOf(job->uri) : std::nullopt; key) {
+            if (const auto entry = cache->lookup(*key); entry and not entry->summary.empty()) {
+                g_print("%s\tok\tcached\n", job->uri);
+                batch->cached++;
+                freeBatchJob(job);
+                continue;
+            }
+        }
+
+        job->attempts++;
+        /* The timeout is read by the discoverer when it starts the next URI */
+        g_object_set(worker->discoverer, "timeout", batchTimeout(*batch, *job), NULL);
+        job->submitted = g_get_monotonic_time();
+        if (not gst_discoverer_discover_uri_async(worker->discoverer, job->uri)) {
+            if (json != nullptr) {
+                writeStatus(*json, job->uri, "error", "unable to start");
+            } else {
+                g_print("%s\tfailed\tunable to start\n", job->uri);
+            }
+            batch->failed++;
+            freeBatchJob(job);
+            continue;
+        }
+        worker->job = job;
+        batch->active++;
+        return G_SOURCE_REMOVE;
+    }
+
+    /* Retried URIs are queued by busy workers, which come back here, so idle one may stop */
+    if (batch->active == 0) {
+        g_main_loop_quit(loop);
+    }
+    return G_SOURCE_REMOVE;
 }
 
-/* This function is called when the discoverer has finished examining
- * all the URIs we provided.*/
 static void
-on_finished_cb(GstDiscoverer* /*discoverer*/)
+onBatchDiscovered(GstDiscoverer* /*discoverer*/,
+                  GstDiscovererInfo* info,
+                  GError* err,
+                  gpointer data)
 {
-    g_print("Finished discovering\n");
-    g_main_loop_quit(loop);
+    auto* worker = static_cast<BatchWorker*>(data);
+    Batch* batch = worker->batch;
+    BatchJob* job = std::exchange(worker->job, nullptr);
+    g_assert(job);
+    batch->active--;
+
+    const GstDiscovererResult result = gst_discoverer_info_get_result(info);
+    if (result == GST_DISCOVERER_TIMEOUT) {
+        batch->timedOut++;
+    }
+
+    if (result == GST_DISCOVERER_OK) {
+        const gdouble elapsed = (g_get_monotonic_time() - job->submitted) / gdouble(G_USEC_PER_SEC);
+        batch->meanTime = (batch->samples++ == 0)
+                              ? elapsed
+                              : batch->meanTime + kTimeoutSmoothing * (elapsed - batch->meanTime);
+
+        if (batch->print and json != nullptr) {
+            writeInfo(*json, info, err);
+        }
+        if (batch->profile == Profile::Fast) {
+            if (batch->print and json == nullptr) {
+                g_print("%s\tok\t%" GST_TIME_FORMAT "\t%s\n",
+                        job->uri,
+                        GST_TIME_ARGS(gst_discoverer_info_get_duration(info)),
+                        describeBrief(info).c_str());
+            }
+            /* Tags and misc are not needed to describe the file briefly */
+            appendIndexed(info, GST_DISCOVERER_SERIALIZE_CAPS);
+        } else {
+            if (batch->print and json == nullptr) {
+                g_print("%s\tok\t%" GST_TIME_FORMAT "\n",
+                        job->uri,
+                        GST_TIME_ARGS(gst_discoverer_info_get_duration(info)));
+            }
+            storeDescribed(job->uri, info);
+            appendIndexed(info);
+        }
+        batch->succeeded++;
+        freeBatchJob(job);
+    } else if ((result == GST_DISCOVERER_TIMEOUT or result == GST_DISCOVERER_ERROR
+                or result == GST_DISCOVERER_BUSY)
+               and job->attempts <= retries) {
+        /* Transient failure, the URI goes to the end of the queue to try later */
+        batch->retried++;
+        g_queue_push_tail(&batch->jobs, job);
+    } else {
+        if (batch->print and json != nullptr) {
+            writeInfo(*json, info, err);
+        } else if (batch->print) {
+            g_print("%s\tfailed\t%s%s%s\n",
+                    job->uri,
+                    resultName(result),
+                    err ? ": " : "",
+                    err ? err->message : "");
+        }
+        batch->failed++;
+        freeBatchJob(job);
+    }
+
+    g_idle_add(onBatchSubmit, worker);
+}
+
+/* Run all URIs through the pool of discoverers, returns FALSE if there is no discoverer */
+static gboolean
+discoverBatch(Batch& batch, GPtrArray* uris, const guint workers)
+{
+    for (guint i = 0; i < uris->len; ++i) {
+        g_queue_push_tail(&batch.jobs,
+                          new BatchJob{g_strdup(static_cast<const gchar*>(uris->pdata[i]))});
+    }
+    batch.total = uris->len;
+
+    loop = g_main_loop_new(nullptr, FALSE);
+    for (guint i = 0; i < MIN(workers, batch.total); ++i) {
+        GError* err{};
+        GstDiscoverer* discoverer = gst_discoverer_new(timeout * GST_SECOND, &err);
+        if (not discoverer) {
+            g_printerr("Error creating discoverer instance: %s\n", err->message);
+            g_clear_error(&err);
+            break;
+        }
+        auto& worker = batch.workers.emplace_back(
+            std::make_unique<BatchWorker>(BatchWorker{&batch, discoverer}));
+        g_signal_connect(
+            discoverer, "discovered", G_CALLBACK(onBatchDiscovered), worker.get());
+        gst_discoverer_start(discoverer);
+        g_idle_add(onBatchSubmit, worker.get());
+    }
+    if (batch.workers.empty()) {
+        g_queue_clear_full(&batch.jobs, GDestroyNotify(freeBatchJob));
+        g_main_loop_unref(loop);
+        return FALSE;
+    }
+
+    const gint64 begin = g_get_monotonic_time();
+    g_main_loop_run(loop);
+    batch.seconds = (g_get_monotonic_time() - begin) / gdouble(G_USEC_PER_SEC);
+
+    for (auto& worker : batch.workers) {
+        gst_discoverer_stop(worker->discoverer);
+        g_object_unref(worker->discoverer);
+    }
+    g_main_loop_unref(loop);
+    return TRUE;
+}
+
+static int
+runBatch(const gchar* listPath, const guint workers, const Profile profile)
+{
+    GPtrArray* uris = readUriList(listPath);
+    if (uris == nullptr) {
+        return EXIT_FAILURE;
+    }
+
+    Batch batch{profile};
+    const gboolean ok = discoverBatch(batch, uris, workers);
+    g_ptr_array_unref(uris);
+    if (not ok) {
+        return EXIT_FAILURE;
+    }
+    saveCache();
+
+    g_printerr("Discovered %u of %u URIs (%u cached or indexed, %u failed, %u retries) "
+               "with %zu discoverers in %.3f s, %.1f URIs/s\n",
+               batch.succeeded + batch.cached,
+               batch.total,
+               batch.cached,
+               batch.failed,
+               batch.retried,
+               batch.workers.size(),
+               batch.seconds,
+               batch.total / batch.seconds);
+    return batch.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Discover the same list with both profiles, cache and index are not used */
+static int
+runBench(const gchar* listPath, const guint workers)
+{
+    GPtrArray* uris = readUriList(listPath);
+    if (uris == nullptr) {
+        return EXIT_FAILURE;
+    }
+    cache = nullptr;
+    discoveryIndex = nullptr;
+
+    g_print("uris: %u, discoverers: %u, timeout: %d s\n", uris->len, workers, timeout);
+    g_print("%-8s %8s %8s %10s %10s %10s %10s\n",
+            "profile",
+            "ok",
+            "failed",
+            "timeouts",
+            "mean (s)",
+            "seconds",
+            "URIs/s");
+    gdouble rates[2]{};
+    for (const Profile profile : {Profile::Full, Profile::Fast}) {
+        Batch batch{profile, FALSE};
+        if (not discoverBatch(batch, uris, workers)) {
+            g_ptr_array_unref(uris);
+            return EXIT_FAILURE;
+        }
+        rates[static_cast<int>(profile)] = batch.total / batch.seconds;
+        g_print("%-8s %8u %8u %10u %10.3f %10.3f %10.1f\n",
+                profileName(profile),
+                batch.succeeded,
+                batch.failed,
+                batch.timedOut,
+                batch.meanTime,
+                batch.seconds,
+                rates[static_cast<int>(profile)]);
+    }
+    g_print("fast/full: %.2fx\n", rates[1] / rates[0]);
+    g_ptr_array_unref(uris);
+    return EXIT_SUCCESS;
 }
 
 int
 main(int argc, char** argv)
 {
+    GOptionEntry options[] = {{"cache",
+                               0,
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &cachePath,
+                               "Discovery results cache file",
+                               nullptr},
+                              {"index",
+                               'i',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &indexPath,
+                               "Serialized discovery index file",
+                               nullptr},
+                              {"batch",
+                               'b',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &batchList,
+                               "Discover every URI (or file path) listed in the file",
+                               nullptr},
+                              {"jobs",
+                               'j',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &jobs,
+                               "Number of concurrent discoverers in batch mode (0 - CPU count)",
+                               nullptr},
+                              {"retries",
+                               'r',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &retries,
+                               "Retries of URI after timeout or error in batch mode",
+                               nullptr},
+                              {"timeout",
+                               't',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &timeout,
+                               "Discovery timeout (seconds), upper bound for fast profile",
+                               nullptr},
+                              {"json",
+                               0,
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &jsonOutput,
+                               "Write one JSON record per URI (NDJSON)",
+                               nullptr},
+                              {"profile",
+                               'p',
+                               0,
+                               G_OPTION_ARG_STRING,
+                               &profile,
+                               "Batch discovery profile (full or fast)",
+                               nullptr},
+                              {"bench",
+                               0,
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &bench,
+                               "Compare throughput of full and fast profiles on the batch list",
+                               nullptr},
+                              {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("[uri]");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    /* Initialize GStreamer */
+    GError* err = NULL;
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_printerr("Error initializing: %s\n", err->message);
+        g_clear_error(&err);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    if (timeout <= 0 or retries < 0
+        or (profile != nullptr and g_strcmp0(profile, "full") != 0
+            and g_strcmp0(profile, "fast") != 0)) {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<MediaCache> cacheHolder;
+    if (cachePath != nullptr) {
+        cacheHolder = std::make_unique<MediaCache>(cachePath);
+        if (not cacheHolder->open(&err)) {
+            g_printerr("Cache is ignored: %s\n", err->message);
+            g_clear_error(&err);
+        }
+        cache = cacheHolder.get();
+    }
+
+    std::unique_ptr<DiscovererIndex> indexHolder;
+    if (indexPath != nullptr) {
+        indexHolder = std::make_unique<DiscovererIndex>(indexPath);
+        if (indexHolder->open(&err)) {
+            discoveryIndex = indexHolder.get();
+        } else {
+            g_printerr("Index is ignored: %s\n", err->message);
+            g_clear_error(&err);
+        }
+    }
+
+    std::unique_ptr<JsonWriter> jsonHolder;
+    if (jsonOutput) {
+        jsonHolder = std::make_unique<JsonWriter>(stdout);
+        json = jsonHolder.get();
+    }
+
+    if (batchList != nullptr) {
+        const guint workers = jobs > 0 ? jobs : g_get_num_processors();
+        if (bench) {
+            return runBench(batchList, workers);
+        }
+        const Profile batchProfile
+            = g_strcmp0(profile, "fast") == 0 ? Profile::Fast : Profile::Full;
+        return runBatch(batchList, workers, batchProfile);
+    }
+
     /* if a URI was provided, use it instead of the default one */
     const gchar* uri = "https://gstreamer.freedesktop.org/data/media/sintel_trailer-480p.webm";
     if (argc > 1) {
         uri = argv[1];
     }
-    g_print("Discovering '%s'\n", uri);
+    if (json == nullptr) {
+        g_print("Discovering '%s'\n", uri);
+    }
 
-    /* Initialize GStreamer */
-    gst_init(&argc, &argv);
+    if (printCached(uri)) {
+        return EXIT_SUCCESS;
+    }
 
     /* Instantiate the Discoverer */
-    GError* err = NULL;
-    discoverer = gst_discoverer_new(5 * GST_SECOND, &err);
+    discoverer = gst_discoverer_new(timeout * GST_SECOND, &err);
     if (not discoverer) {
         g_print("Error creating discoverer instance: %s\n", err->message);
         g_clear_error(&err);
@@ -216,6 +1096,7 @@ main(int argc, char** argv)
 
     /* Stop the discoverer process */
     gst_discoverer_stop(discoverer);
+    saveCache();
 
     /* Free resources */
     g_object_unref(discoverer);
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "common/Utils.hpp"
+#include "common/TaskPoolRegistry.hpp"
+#include "common/ThreadPolicy.hpp"
 
 #include "CustomRtPool.hpp"
 
@@ -20,13 +22,109 @@
  * Example 12: Manual threads configuration
  *  + creating custom threads pool
  *  + creating threads with custom policy and priority
+ *  + reusing persistent pool threads between task starts
+ *  + sharing pools between tasks of the same class
+ *  + applying CPU affinity and scheduling policy per element path
+ *  + deriving SCHED_DEADLINE budget from negotiated framerate
+ *  + accounting CPU time, context switches and page faults per thread
+ *  + locking memory and prefaulting thread stacks (RT determinism mode)
  */
 
 static GMainLoop* mainLoop{};
+static GstElement* pipeline{};
+static gchar* poolClasses{};
+static gchar* policyFile{};
+static ThreadPolicyMap policyMap;
+static gint statsInterval{};
+static gboolean determinism{};
+static gint stackSize{};
+static GPtrArray* pools{};
+
+/* Called in the streaming thread when caps event leaves the task owner */
+static GstPadProbeReturn
+onOwnerCaps(GstPad* /*pad*/, GstPadProbeInfo* info, gpointer data)
+{
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstCaps* caps{};
+    gst_event_parse_caps(event, &caps);
+    gint fpsN{}, fpsD{};
+    if (const GstStructure* s = gst_caps_get_structure(caps, 0);
+        s != nullptr and gst_structure_get_fraction(s, "framerate", &fpsN, &fpsD)) {
+        /* The budget belongs to this thread only, other tasks of the pool keep theirs */
+        custom_rt_pool_apply_scheduling(CUSTOM_RT_POOL(data), fpsN, fpsD);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Framerate of already negotiated task owner (restarted task), 0/0 otherwise */
+static void
+ownerFramerate(GstElement* owner, gint& fpsN, gint& fpsD)
+{
+    fpsN = fpsD = 0;
+    GstPad* srcPad = gst_element_get_static_pad(owner, "src");
+    if (srcPad == nullptr) {
+        return;
+    }
+    if (GstCaps* caps = gst_pad_get_current_caps(srcPad); caps != nullptr) {
+        const GstStructure* s = gst_caps_get_structure(caps, 0);
+        if (s == nullptr or not gst_structure_get_fraction(s, "framerate", &fpsN, &fpsD)) {
+            fpsN = fpsD = 0;
+        }
+        gst_caps_unref(caps);
+    }
+    gst_object_unref(srcPad);
+}
+
+static void
+onPoolSnapshot(CustomRtPool* pool, GArray* snapshot, gpointer /*data*/)
+{
+    g_print("Pool %p threads:\n", pool);
+    for (guint i = 0; i < snapshot->len; ++i) {
+        const auto& stats = g_array_index(snapshot, CustomRtThreadStats, i);
+        g_print("  tid %6d %-4s cpu %8" G_GUINT64_FORMAT " us, csw %6" G_GUINT64_FORMAT
+                "/%-6" G_GUINT64_FORMAT " faults %6" G_GUINT64_FORMAT "/%-4" G_GUINT64_FORMAT
+                " %s\n",
+                stats.tid,
+                stats.alive ? "" : "gone",
+                stats.cpuTime / GST_USECOND,
+                stats.voluntarySwitches,
+                stats.involuntarySwitches,
+                stats.minorFaults,
+                stats.majorFaults,
+                stats.element ? stats.element : "<idle>");
+    }
+}
+
+/* Budget of deadline scheduling is known only after caps negotiation */
+static void
+watchOwnerCaps(GstElement* owner, GstTaskPool* pool)
+{
+    GstPad* srcPad = gst_element_get_static_pad(owner, "src");
+    if (srcPad == nullptr) {
+        return;
+    }
+    /* The task enters again after each restart, install the probe only once */
+    if (g_object_get_data(G_OBJECT(srcPad), "rt-pool-probe") == nullptr) {
+        const gulong id = gst_pad_add_probe(srcPad,
+                                            GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                                            onOwnerCaps,
+                                            gst_object_ref(pool),
+                                            gst_object_unref);
+        g_object_set_data(G_OBJECT(srcPad), "rt-pool-probe", GSIZE_TO_POINTER(id));
+    }
+    gst_object_unref(srcPad);
+}
 
 static void
-onPipelineStreamStatus(GstBus* /*bus*/, GstMessage* message, gpointer /*userData*/)
+onPipelineStreamStatus(GstBus* /*bus*/, GstMessage* message, gpointer userData)
 {
+    auto* registry = static_cast<TaskPoolRegistry*>(userData);
+    g_assert(registry);
+
     g_message("Received <STREAM_STATUS>");
 
     GstElement* owner{};
@@ -37,9 +135,8 @@ onPipelineStreamStatus(GstBus* /*bus*/, GstMessage* message, gpointer /*userData
     gchar* path = gst_object_get_path_string(GST_MESSAGE_SRC(message));
     g_message("...source: %s", path);
     g_free(path);
-    path = gst_object_get_path_string(GST_OBJECT(owner));
-    g_message("...owner:  %s", path);
-    g_free(path);
+    gchar* ownerPath = gst_object_get_path_string(GST_OBJECT(owner));
+    g_message("...owner:  %s", ownerPath);
 
     GstTask* task{};
     if (const GValue* val = gst_message_get_stream_status_object(message);
@@ -51,20 +148,49 @@ onPipelineStreamStatus(GstBus* /*bus*/, GstMessage* message, gpointer /*userData
     case GST_STREAM_STATUS_TYPE_CREATE:
         g_message("...status: create");
         if (task) {
-            GstTaskPool* pool = custom_rt_pool_new();
-            g_assert(pool);
-            gst_task_set_pool(task, pool);
+            registry->assign(pipeline, owner, task);
         }
         break;
     case GST_STREAM_STATUS_TYPE_ENTER:
         g_message("...status: enter");
+        /* The message is posted from the streaming thread itself */
+        if (GstTaskPool* pool = task ? gst_task_get_pool(task) : nullptr; pool) {
+            if (CUSTOM_IS_RT_POOL(pool)) {
+                custom_rt_pool_label_thread(CUSTOM_RT_POOL(pool), ownerPath);
+                /**
+                 * Worker may come from another task, its class is set again. Policy
+                 * matching the owner path wins: the worker drops any deadline budget
+                 * (affinity of SCHED_DEADLINE thread can't be changed) and the policy is
+                 * applied on top of the non-deadline chain.
+                 */
+                gint fpsN{}, fpsD{};
+                const gboolean matched = policyMap.find(ownerPath) != nullptr;
+                if (not matched) {
+                    ownerFramerate(owner, fpsN, fpsD);
+                }
+                custom_rt_pool_apply_scheduling(CUSTOM_RT_POOL(pool), fpsN, fpsD);
+                if (not matched) {
+                    watchOwnerCaps(owner, pool);
+                }
+            }
+            gst_object_unref(pool);
+        }
+        policyMap.applyFor(ownerPath);
         break;
     case GST_STREAM_STATUS_TYPE_LEAVE:
         g_message("...status: leave");
         break;
+    case GST_STREAM_STATUS_TYPE_DESTROY:
+        g_message("...status: destroy");
+        if (task) {
+            registry->unassign(task);
+        }
+        break;
     default:
         break;
     }
+
+    g_free(ownerPath);
 }
 
 static void
@@ -82,22 +208,130 @@ onPipelineError(GstBus* /*bus*/, GstMessage* message, gpointer /*userData*/)
     g_main_loop_quit(mainLoop);
 }
 
+static gboolean
+onWarmedUp(gpointer /*data*/)
+{
+    /* Threads have run the steady state for a while, any further fault is a stall */
+    for (guint i = 0; i < pools->len; ++i) {
+        custom_rt_pool_mark_warmup(static_cast<CustomRtPool*>(g_ptr_array_index(pools, i)));
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Buffers reaching the sink before the end of warm-up (start-up faults are not counted) */
+static constexpr guint kWarmupBuffers{10};
+
+static GstPadProbeReturn
+onSinkBuffer(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer /*data*/)
+{
+    static guint count{};
+    if (++count < kWarmupBuffers) {
+        return GST_PAD_PROBE_OK;
+    }
+    g_idle_add(onWarmedUp, nullptr);
+    return GST_PAD_PROBE_REMOVE;
+}
+
 static void
-onPipelineEos(GstBus* bus, GstMessage* message, gpointer user_data)
+onPipelineEos(GstBus* bus, GstMessage* message, gpointer userData)
 {
     g_message("Received EoS");
+
+    auto* registry = static_cast<TaskPoolRegistry*>(userData);
+    g_assert(registry);
+    registry->dump();
+
+    if (determinism) {
+        for (guint i = 0; i < pools->len; ++i) {
+            auto* pool = static_cast<CustomRtPool*>(g_ptr_array_index(pools, i));
+            g_print("Pool %p: %" G_GUINT64_FORMAT " faults after warm-up\n",
+                    pool,
+                    custom_rt_pool_check_faults(pool));
+        }
+    }
+
     g_main_loop_quit(mainLoop);
 }
 
 int
 main(int argc, char* argv[])
 {
-    // Initialize gstreamer
-    gst_init(&argc, &argv);
+    GOptionEntry options[] = {{"pool-classes",
+                               'c',
+                               0,
+                               G_OPTION_ARG_STRING,
+                               &poolClasses,
+                               "Task classes (comma-separated list of <owner-path-glob>=<class>)",
+                               nullptr},
+                              {"policy",
+                               'p',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &policyFile,
+                               "Thread policy config (element path globs to CPU and scheduling)",
+                               nullptr},
+                              {"stats-interval",
+                               's',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &statsInterval,
+                               "Interval of printing thread accounting (ms, 0 - disabled)",
+                               nullptr},
+                              {"determinism",
+                               'd',
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &determinism,
+                               "Lock memory and prefault thread stacks",
+                               nullptr},
+                              {"stack-size",
+                               0,
+                               0,
+                               G_OPTION_ARG_INT,
+                               &stackSize,
+                               "Size of prefaulted thread stack (KiB)",
+                               nullptr},
+                              {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    GError* err{};
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_error("Error initializing: %s\n", err->message);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    // Load thread policies applied when streaming thread enters
+    if (policyFile != nullptr and not policyMap.load(policyFile, &err)) {
+        g_printerr("Unable to load thread policy: %s\n", err->message);
+        g_clear_error(&err);
+        return EXIT_FAILURE;
+    }
+
+    // Create registry of pools shared by the tasks of the same class
+    pools = g_ptr_array_new();
+    TaskPoolRegistry registry{[](const std::string& taskClass) {
+        g_message("Creating pool of '%s' class", taskClass.c_str());
+        GstTaskPool* pool = custom_rt_pool_new();
+        custom_rt_pool_set_determinism(CUSTOM_RT_POOL(pool), determinism, stackSize * 1024);
+        g_ptr_array_add(pools, pool);
+        if (statsInterval > 0) {
+            custom_rt_pool_add_snapshot_watch(
+                CUSTOM_RT_POOL(pool), statsInterval, onPoolSnapshot, nullptr);
+        }
+        return pool;
+    }};
+    if (not registry.parseClassRules(poolClasses)) {
+        return EXIT_FAILURE;
+    }
 
     // Create a new bin to hold the elements
     GstElement* bin = gst_pipeline_new("pipeline");
     g_assert(bin);
+    pipeline = bin;
 
     // Create source element
     GstElement* src = gst_element_factory_make("fakesrc", "src");
@@ -114,14 +348,21 @@ main(int argc, char* argv[])
     // Link the elements
     gst_element_link(src, sink);
 
+    if (determinism) {
+        GstPad* sinkPad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, onSinkBuffer, nullptr, nullptr);
+        gst_object_unref(sinkPad);
+    }
+
     // Configure message handlers
     GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(bin));
     g_assert(bus);
     gst_bus_enable_sync_message_emission(bus);
     gst_bus_add_signal_watch(bus);
-    g_signal_connect(bus, "sync-message::stream-status", GCallback(onPipelineStreamStatus), NULL);
+    g_signal_connect(
+        bus, "sync-message::stream-status", GCallback(onPipelineStreamStatus), &registry);
     g_signal_connect(bus, "message::error", GCallback(onPipelineError), NULL);
-    g_signal_connect(bus, "message::eos", GCallback(onPipelineEos), NULL);
+    g_signal_connect(bus, "message::eos", GCallback(onPipelineEos), &registry);
     gst_object_unref(bus);
 
     // Start playing
@@ -131,8 +372,11 @@ main(int argc, char* argv[])
     mainLoop = g_main_loop_new(nullptr, FALSE);
     g_main_loop_run(mainLoop);
 
-    // Tear-down pipeline and loop
+    // Tear-down pipeline, its pools and loop
     gst_element_set_state(bin, GST_STATE_NULL);
+    registry.release(bin);
+    g_ptr_array_unref(pools);
+    gst_object_unref(bin);
     g_main_loop_unref(mainLoop);
 
     return 0;
@@ -0,0 +1,257 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/TaskPoolRegistry.hpp"
+
+#include "CustomRtPool.hpp"
+
+#include <memory>
+
+#include <ctime>
+
+/**
+ * Example 12 (benchmark): Per-buffer dataflow overhead
+ *  + "fakesrc ! queue ! ... ! fakesink" topology from example 12
+ *  + the number of queues (thread boundaries) is swept from 0 to the given maximum
+ *  + each topology runs with the default and the custom RT task pool
+ *  + reports the cost of one buffer (ns/buffer) and the throughput (buffers/s)
+ */
+
+static gint buffers = 100000;
+static gint bufferSize = 64;
+static gint queues = 3;
+static gint maxSizeBuffers = 200;
+static gint maxSizeBytes = 10 * 1024 * 1024;
+static gint64 maxSizeTime = GST_SECOND;
+static gchar* poolName{};
+
+struct Run {
+    gboolean customPool{};
+    std::unique_ptr<TaskPoolRegistry> registry;
+    GstElement* pipeline{};
+    gint64 first{};
+    gint64 last{};
+    guint64 count{};
+};
+
+static gint64
+nowNs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return gint64{ts.tv_sec} * GST_SECOND + ts.tv_nsec;
+}
+
+/* Called in the thread of the last queue (or source) for each buffer reaching the sink */
+static GstPadProbeReturn
+onSinkBuffer(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer data)
+{
+    auto* run = static_cast<Run*>(data);
+    run->last = nowNs();
+    if (run->count++ == 0) {
+        run->first = run->last;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstBusSyncReply
+onSyncMessage(GstBus* /*bus*/, GstMessage* message, gpointer data)
+{
+    auto* run = static_cast<Run*>(data);
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS or not run->customPool) {
+        return GST_BUS_PASS;
+    }
+
+    GstElement* owner{};
+    GstStreamStatusType type{};
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_CREATE) {
+        if (const GValue* val = gst_message_get_stream_status_object(message);
+            G_VALUE_TYPE(val) == GST_TYPE_TASK) {
+            run->registry->assign(
+                run->pipeline, owner, static_cast<GstTask*>(g_value_get_object(val)));
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+static GstElement*
+createPipeline(Run& run, const gint boundaries)
+{
+    GstElement* pipeline = gst_pipeline_new("pipeline");
+    g_assert(pipeline);
+
+    GstElement* src = gst_element_factory_make("fakesrc", "src");
+    g_assert(src);
+    g_object_set(src,
+                 "num-buffers",
+                 buffers,
+                 "sizetype",
+                 2 /* fixed */,
+                 "sizemax",
+                 bufferSize,
+                 "silent",
+                 TRUE,
+                 NULL);
+
+    GstElement* sink = gst_element_factory_make("fakesink", "sink");
+    g_assert(sink);
+    g_object_set(sink, "sync", FALSE, "silent", TRUE, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, sink, NULL);
+
+    GstElement* prev = src;
+    for (gint i = 0; i < boundaries; ++i) {
+        GstElement* queue = gst_element_factory_make("queue", nullptr);
+        g_assert(queue);
+        g_object_set(queue,
+                     "max-size-buffers",
+                     guint(maxSizeBuffers),
+                     "max-size-bytes",
+                     guint(maxSizeBytes),
+                     "max-size-time",
+                     guint64(maxSizeTime),
+                     NULL);
+        gst_bin_add(GST_BIN(pipeline), queue);
+        gst_element_link(prev, queue);
+        prev = queue;
+    }
+    gst_element_link(prev, sink);
+
+    GstPad* sinkPad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, onSinkBuffer, &run, nullptr);
+    gst_object_unref(sinkPad);
+
+    return pipeline;
+}
+
+/* Returns the cost of one buffer in ns or negative value on failure */
+static gdouble
+runOnce(const gint boundaries, const gboolean customPool)
+{
+    Run run;
+    run.customPool = customPool;
+    run.registry = std::make_unique<TaskPoolRegistry>(
+        [](const std::string& /*taskClass*/) { return custom_rt_pool_new(); });
+    run.pipeline = createPipeline(run, boundaries);
+
+    GstBus* bus = gst_element_get_bus(run.pipeline);
+    gst_bus_set_sync_handler(bus, onSyncMessage, &run, nullptr);
+
+    gst_element_set_state(run.pipeline, GST_STATE_PLAYING);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    const gboolean ok = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (not ok) {
+        GError* error{};
+        gst_message_parse_error(msg, &error, nullptr);
+        g_printerr("Error: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+
+    gst_element_set_state(run.pipeline, GST_STATE_NULL);
+    gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+    gst_object_unref(bus);
+    run.registry->release(run.pipeline);
+    gst_object_unref(run.pipeline);
+
+    if (not ok or run.count < 2) {
+        return -1.0;
+    }
+    return static_cast<gdouble>(run.last - run.first) / static_cast<gdouble>(run.count - 1);
+}
+
+int
+main(int argc, char* argv[])
+{
+    GOptionEntry options[] = {
+        {"buffers", 'n', 0, G_OPTION_ARG_INT, &buffers, "Number of buffers per run", nullptr},
+        {"size", 's', 0, G_OPTION_ARG_INT, &bufferSize, "Size of buffer (bytes)", nullptr},
+        {"queues", 'q', 0, G_OPTION_ARG_INT, &queues, "Maximum number of queues", nullptr},
+        {"max-size-buffers", 0, 0, G_OPTION_ARG_INT, &maxSizeBuffers, "Queue limit", nullptr},
+        {"max-size-bytes", 0, 0, G_OPTION_ARG_INT, &maxSizeBytes, "Queue limit", nullptr},
+        {"max-size-time", 0, 0, G_OPTION_ARG_INT64, &maxSizeTime, "Queue limit (ns)", nullptr},
+        {"pool", 'p', 0, G_OPTION_ARG_STRING, &poolName, "Pool (default, rt or both)", nullptr},
+        {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    GError* err{};
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_error("Error initializing: %s\n", err->message);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    if (buffers < 2 or bufferSize <= 0 or queues < 0 or maxSizeBuffers < 0 or maxSizeBytes < 0
+        or maxSizeTime < 0
+        or (poolName != nullptr and not g_str_equal(poolName, "default")
+            and not g_str_equal(poolName, "rt") and not g_str_equal(poolName, "both"))) {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    const gboolean runDefault = poolName == nullptr or g_str_equal(poolName, "default")
+                                or g_str_equal(poolName, "both");
+    const gboolean runCustom = poolName == nullptr or g_str_equal(poolName, "rt")
+                               or g_str_equal(poolName, "both");
+
+    /* Pools are noisy at message level, keep the report readable */
+    g_log_set_handler(
+        nullptr,
+        G_LOG_LEVEL_MESSAGE,
+        [](const gchar* /*domain*/, GLogLevelFlags /*level*/, const gchar* /*msg*/, gpointer) {},
+        nullptr);
+
+    g_print("buffers: %d, size: %d, queue limits: %d buffers, %d bytes, %" G_GINT64_FORMAT
+            " ns\n",
+            buffers,
+            bufferSize,
+            maxSizeBuffers,
+            maxSizeBytes,
+            maxSizeTime);
+    g_print("%-8s %-8s %12s %14s %16s\n",
+            "queues",
+            "pool",
+            "ns/buffer",
+            "buffers/s",
+            "+ns/boundary");
+
+    gboolean ok{TRUE};
+    for (const gboolean customPool : {FALSE, TRUE}) {
+        if ((customPool and not runCustom) or (not customPool and not runDefault)) {
+            continue;
+        }
+        gdouble previous{-1.0};
+        for (gint boundaries = 0; boundaries <= queues; ++boundaries) {
+            const gdouble cost = runOnce(boundaries, customPool);
+            if (cost < 0) {
+                ok = FALSE;
+                break;
+            }
+            g_print("%-8d %-8s %12.1f %14.0f %16.1f\n",
+                    boundaries,
+                    customPool ? "rt" : "default",
+                    cost,
+                    GST_SECOND / cost,
+                    previous < 0 ? 0.0 : cost - previous);
+            previous = cost;
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,437 @@
+// Copyright 2025 Denys Asauliak
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/TaskPoolRegistry.hpp"
+#include "common/ThreadPolicy.hpp"
+
+#include "CustomRtPool.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <csignal>
+#include <ctime>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Example 12 (benchmark): Streaming thread wakeup latency
+ *  + "fakesrc ! identity ! queue ! ... ! fakesink" topology from example 12
+ *  + each buffer is timestamped when pushed into a queue and when the queue
+ *    thread chains it downstream, the difference is the wakeup latency
+ *  + runs with default pool, custom RT pool and pinned custom RT pool,
+ *    with and without synthetic background CPU load
+ *  + optionally runs custom pools in RT determinism mode and reports page faults
+ *    of pool threads after warm-up
+ */
+
+static gint buffers = 2000;
+static gint interval = 1000;
+static gint queues = 1;
+static gint maxLatency = 10000;
+static gboolean printHistogram{};
+static gboolean determinism{};
+
+enum class PoolConfig { Default, Realtime, Pinned };
+
+static const gchar*
+poolConfigName(const PoolConfig config)
+{
+    switch (config) {
+    case PoolConfig::Default:
+        return "default";
+    case PoolConfig::Realtime:
+        return "rt";
+    case PoolConfig::Pinned:
+        return "rt-pinned";
+    }
+    return "unknown";
+}
+
+/* Histogram of latencies with 1us buckets (the same as cyclictest uses) */
+struct Histogram {
+    std::vector<guint64> buckets;
+    guint64 overflows{};
+    guint64 count{};
+    gint64 min{G_MAXINT64};
+    gint64 max{};
+    gint64 sum{};
+
+    explicit Histogram(const gint size)
+        : buckets(size, 0)
+    {
+    }
+
+    void
+    add(const gint64 ns)
+    {
+        const gint64 us = ns / 1000;
+        if (us < static_cast<gint64>(buckets.size())) {
+            buckets[us]++;
+        } else {
+            overflows++;
+        }
+        min = MIN(min, us);
+        max = MAX(max, us);
+        sum += us;
+        count++;
+    }
+
+    void
+    merge(const Histogram& other)
+    {
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        overflows += other.overflows;
+        count += other.count;
+        min = MIN(min, other.min);
+        max = MAX(max, other.max);
+        sum += other.sum;
+    }
+
+    [[nodiscard]] gint64
+    percentile(const gdouble p) const
+    {
+        const auto target = static_cast<guint64>(p * static_cast<gdouble>(count));
+        guint64 seen{};
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            seen += buckets[i];
+            if (seen > target) {
+                return static_cast<gint64>(i);
+            }
+        }
+        return max;
+    }
+};
+
+/* Push timestamps of the buffers currently waiting in one queue */
+struct QueueProbe {
+    std::mutex guard;
+    std::deque<gint64> stamps;
+    Histogram histogram{maxLatency};
+};
+
+struct Run {
+    PoolConfig config{};
+    std::unique_ptr<TaskPoolRegistry> registry;
+    GstElement* pipeline{};
+    std::vector<std::unique_ptr<QueueProbe>> probes;
+    std::vector<CustomRtPool*> pools;
+    gint nextCpu{};
+};
+
+static gint64
+nowNs()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return gint64{ts.tv_sec} * GST_SECOND + ts.tv_nsec;
+}
+
+static GstPadProbeReturn
+onQueuePush(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer data)
+{
+    auto* probe = static_cast<QueueProbe*>(data);
+    const gint64 now = nowNs();
+    std::lock_guard lock{probe->guard};
+    probe->stamps.push_back(now);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+onQueueChain(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer data)
+{
+    auto* probe = static_cast<QueueProbe*>(data);
+    const gint64 now = nowNs();
+    gint64 pushed{};
+    {
+        std::lock_guard lock{probe->guard};
+        if (probe->stamps.empty()) {
+            return GST_PAD_PROBE_OK;
+        }
+        pushed = probe->stamps.front();
+        probe->stamps.pop_front();
+    }
+    probe->histogram.add(now - pushed);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstBusSyncReply
+onSyncMessage(GstBus* /*bus*/, GstMessage* message, gpointer data)
+{
+    auto* run = static_cast<Run*>(data);
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS
+        or run->config == PoolConfig::Default) {
+        return GST_BUS_PASS;
+    }
+
+    GstElement* owner{};
+    GstStreamStatusType type{};
+    gst_message_parse_stream_status(message, &type, &owner);
+
+    GstTask* task{};
+    if (const GValue* val = gst_message_get_stream_status_object(message);
+        G_VALUE_TYPE(val) == GST_TYPE_TASK) {
+        task = static_cast<GstTask*>(g_value_get_object(val));
+    }
+
+    if (type == GST_STREAM_STATUS_TYPE_CREATE and task != nullptr) {
+        run->registry->assign(run->pipeline, owner, task);
+    } else if (type == GST_STREAM_STATUS_TYPE_ENTER and run->config == PoolConfig::Pinned) {
+        /* Pin each streaming thread to own CPU, counting from the last one */
+        const gint cpus = static_cast<gint>(g_get_num_processors());
+        const gint cpu = cpus - 1 - (g_atomic_int_add(&run->nextCpu, 1) % cpus);
+        ThreadPolicyMap::apply(ThreadPolicy{"pinned", "", {cpu}});
+    }
+    return GST_BUS_PASS;
+}
+
+static GstElement*
+createPipeline(Run& run)
+{
+    GstElement* pipeline = gst_pipeline_new("pipeline");
+    g_assert(pipeline);
+
+    GstElement* src = gst_element_factory_make("fakesrc", "src");
+    g_assert(src);
+    g_object_set(src, "num-buffers", buffers, "sizetype", 2, "sizemax", 64, NULL);
+
+    /* Pace the source, so queues run empty and downstream threads sleep between buffers */
+    GstElement* pace = gst_element_factory_make("identity", "pace");
+    g_assert(pace);
+    g_object_set(pace, "sleep-time", guint(interval), NULL);
+
+    GstElement* sink = gst_element_factory_make("fakesink", "sink");
+    g_assert(sink);
+    g_object_set(sink, "sync", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, pace, sink, NULL);
+    gst_element_link(src, pace);
+
+    GstElement* prev = pace;
+    for (gint i = 0; i < queues; ++i) {
+        gchar* name = g_strdup_printf("queue%d", i);
+        GstElement* queue = gst_element_factory_make("queue", name);
+        g_assert(queue);
+        g_free(name);
+        gst_bin_add(GST_BIN(pipeline), queue);
+        gst_element_link(prev, queue);
+
+        auto& probe = run.probes.emplace_back(std::make_unique<QueueProbe>());
+        GstPad* sinkPad = gst_element_get_static_pad(queue, "sink");
+        gst_pad_add_probe(
+            sinkPad, GST_PAD_PROBE_TYPE_BUFFER, onQueuePush, probe.get(), nullptr);
+        gst_object_unref(sinkPad);
+        GstPad* srcPad = gst_element_get_static_pad(queue, "src");
+        gst_pad_add_probe(
+            srcPad, GST_PAD_PROBE_TYPE_BUFFER, onQueueChain, probe.get(), nullptr);
+        gst_object_unref(srcPad);
+
+        prev = queue;
+    }
+    gst_element_link(prev, sink);
+
+    return pipeline;
+}
+
+/* Spawn busy-looping processes, one per CPU (processes keep their context switches apart) */
+static std::vector<pid_t>
+startLoad()
+{
+    std::vector<pid_t> children;
+    for (guint i = 0; i < g_get_num_processors(); ++i) {
+        if (const pid_t pid = fork(); pid == 0) {
+            volatile guint64 counter{};
+            while (true) {
+                counter = counter + 1;
+            }
+        } else if (pid > 0) {
+            children.push_back(pid);
+        }
+    }
+    return children;
+}
+
+static void
+stopLoad(const std::vector<pid_t>& children)
+{
+    for (const pid_t pid : children) {
+        kill(pid, SIGKILL);
+    }
+    for (const pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+static void
+report(const Run& run,
+       const gboolean loaded,
+       const rusage& before,
+       const rusage& after,
+       const guint64 faults)
+{
+    Histogram total{maxLatency};
+    for (const auto& probe : run.probes) {
+        total.merge(probe->histogram);
+    }
+
+    g_print("%-10s %-6s samples: %8" G_GUINT64_FORMAT " min: %6" G_GINT64_FORMAT
+            " avg: %6" G_GINT64_FORMAT " p99: %6" G_GINT64_FORMAT " max: %6" G_GINT64_FORMAT
+            " us, overflows: %" G_GUINT64_FORMAT ", csw: %ld/%ld (vol/invol), faults: %"
+            G_GUINT64_FORMAT "/%ld (pool after warm-up/process)\n",
+            poolConfigName(run.config),
+            loaded ? "load" : "idle",
+            total.count,
+            total.count ? total.min : 0,
+            total.count ? total.sum / static_cast<gint64>(total.count) : 0,
+            total.percentile(0.99),
+            total.max,
+            total.overflows,
+            after.ru_nvcsw - before.ru_nvcsw,
+            after.ru_nivcsw - before.ru_nivcsw,
+            faults,
+            (after.ru_minflt + after.ru_majflt) - (before.ru_minflt + before.ru_majflt));
+
+    if (printHistogram) {
+        g_print("# Histogram\n");
+        for (std::size_t i = 0; i < total.buckets.size(); ++i) {
+            if (total.buckets[i] > 0) {
+                g_print("%06zu %06" G_GUINT64_FORMAT "\n", i, total.buckets[i]);
+            }
+        }
+        g_print("# Histogram Overflows: %05" G_GUINT64_FORMAT "\n", total.overflows);
+    }
+}
+
+static gboolean
+runOnce(const PoolConfig config, const gboolean loaded)
+{
+    Run run;
+    run.config = config;
+    run.registry = std::make_unique<TaskPoolRegistry>([&run](const std::string& /*taskClass*/) {
+        GstTaskPool* pool = custom_rt_pool_new();
+        custom_rt_pool_set_determinism(CUSTOM_RT_POOL(pool), determinism, 0);
+        run.pools.push_back(CUSTOM_RT_POOL(pool));
+        return pool;
+    });
+    run.pipeline = createPipeline(run);
+
+    GstBus* bus = gst_element_get_bus(run.pipeline);
+    gst_bus_set_sync_handler(bus, onSyncMessage, &run, nullptr);
+
+    std::vector<pid_t> load;
+    if (loaded) {
+        load = startLoad();
+    }
+
+    rusage before{}, after{};
+    getrusage(RUSAGE_SELF, &before);
+
+    gst_element_set_state(run.pipeline, GST_STATE_PLAYING);
+
+    /* Treat the first 10% of buffers as warm-up */
+    const auto filter = GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    const GstClockTime warmup = gst_util_uint64_scale(buffers, interval * GST_USECOND, 10);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, warmup, filter);
+    if (msg == nullptr) {
+        for (CustomRtPool* pool : run.pools) {
+            custom_rt_pool_mark_warmup(pool);
+        }
+        msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, filter);
+    }
+    const gboolean ok = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (not ok) {
+        GError* error{};
+        gst_message_parse_error(msg, &error, nullptr);
+        g_printerr("Error: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+
+    getrusage(RUSAGE_SELF, &after);
+    stopLoad(load);
+
+    guint64 faults{};
+    for (CustomRtPool* pool : run.pools) {
+        faults += custom_rt_pool_check_faults(pool);
+    }
+
+    gst_element_set_state(run.pipeline, GST_STATE_NULL);
+    gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+    gst_object_unref(bus);
+    run.registry->release(run.pipeline);
+    gst_object_unref(run.pipeline);
+
+    if (ok) {
+        report(run, loaded, before, after, faults);
+    }
+    return ok;
+}
+
+int
+main(int argc, char* argv[])
+{
+    GOptionEntry options[] = {
+        {"buffers", 'n', 0, G_OPTION_ARG_INT, &buffers, "Number of buffers per run", nullptr},
+        {"interval", 'i', 0, G_OPTION_ARG_INT, &interval, "Source interval (us)", nullptr},
+        {"queues", 'q', 0, G_OPTION_ARG_INT, &queues, "Number of queues", nullptr},
+        {"max", 'm', 0, G_OPTION_ARG_INT, &maxLatency, "Histogram size (us)", nullptr},
+        {"histogram", 'H', 0, G_OPTION_ARG_NONE, &printHistogram, "Print histograms", nullptr},
+        {"determinism", 'd', 0, G_OPTION_ARG_NONE, &determinism, "RT determinism mode", nullptr},
+        {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    GError* err{};
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_error("Error initializing: %s\n", err->message);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    if (buffers <= 0 or interval < 0 or queues <= 0 or maxLatency <= 0) {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Pools are noisy at message level, keep the report readable */
+    g_log_set_handler(
+        nullptr,
+        G_LOG_LEVEL_MESSAGE,
+        [](const gchar* /*domain*/, GLogLevelFlags /*level*/, const gchar* /*msg*/, gpointer) {},
+        nullptr);
+
+    g_print("buffers: %d, interval: %d us, queues: %d, cpus: %u\n",
+            buffers,
+            interval,
+            queues,
+            g_get_num_processors());
+
+    gboolean ok{TRUE};
+    for (const gboolean loaded : {FALSE, TRUE}) {
+        for (const PoolConfig config :
+             {PoolConfig::Default, PoolConfig::Realtime, PoolConfig::Pinned}) {
+            ok &= runOnce(config, loaded);
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
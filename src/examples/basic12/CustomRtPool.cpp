@@ -14,79 +14,425 @@
 
 #include "CustomRtPool.hpp"
 
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 static void
 custom_rt_pool_finalize(GObject* object);
 
+/* Completion handle of the pushed function, returned by push and waited by join */
 typedef struct {
-    pthread_t thread{};
+    GstTaskPoolFunction func{};
+    gpointer data{};
+    GMutex lock;
+    GCond cond;
+    gboolean done{};
 } CustomRtId;
 
+/* Worker thread and its own stack (allocated in determinism mode only) */
+typedef struct {
+    pthread_t thread{};
+    gpointer stack{};
+    gsize stackSize{};
+} CustomRtWorker;
+
+/* Special job which makes the worker to leave the loop */
+static CustomRtId stopJob{};
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* Argument of sched_setattr syscall (no glibc wrapper on most systems) */
+typedef struct {
+    guint32 size;
+    guint32 policy;
+    guint64 flags;
+    gint32 nice;
+    guint32 priority;
+    guint64 runtime;
+    guint64 deadline;
+    guint64 period;
+} CustomSchedAttr;
+
 G_DEFINE_TYPE(CustomRtPool, custom_rt_pool, GST_TYPE_TASK_POOL);
 
+static gboolean
+setDeadline(guint64 runtime, guint64 period)
+{
+#ifdef SYS_sched_setattr
+    CustomSchedAttr attr{};
+    attr.size = sizeof(attr);
+    attr.policy = SCHED_DEADLINE;
+    attr.runtime = runtime;
+    attr.deadline = period;
+    attr.period = period;
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0) {
+        return TRUE;
+    }
+    g_message("Set deadline has failed, %s", g_strerror(errno));
+#endif
+    return FALSE;
+}
+
+static gboolean
+setRealtime(gint policy, gint priority)
+{
+    sched_param param{};
+    param.sched_priority = priority;
+    if (const gint rv = pthread_setschedparam(pthread_self(), policy, &param); rv != 0) {
+        g_message("Set policy %d has failed, %s", policy, g_strerror(rv));
+        return FALSE;
+    }
+    return TRUE;
+}
+
 static void
-defaultPrepare(GstTaskPool* pool, GError** /*error*/)
+setLowestNice()
 {
-    /**
-     * We don't do anything here.
-     * We could construct a pool of threads here to reuse it later.
-     */
-    g_message("Pool %p: prepare", pool);
+    /* The lowest nice value unprivileged thread may set is limited by RLIMIT_NICE */
+    gint lowest = -20;
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NICE, &limit) == 0 and limit.rlim_cur != RLIM_INFINITY) {
+        lowest = MAX(lowest, 20 - static_cast<gint>(limit.rlim_cur));
+    }
+
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    errno = 0;
+    if (const gint current = getpriority(PRIO_PROCESS, tid); errno == 0 and lowest < current) {
+        if (setpriority(PRIO_PROCESS, tid, lowest) != 0) {
+            g_message("Set nice %d has failed, %s", lowest, g_strerror(errno));
+        }
+    }
+}
+
+static gint
+currentTid()
+{
+    return static_cast<gint>(syscall(SYS_gettid));
+}
+
+/* Must be called with pool lock taken */
+static CustomRtThreadStats*
+findStats(CustomRtPool* pool, const gint tid)
+{
+    for (guint i = 0; i < pool->stats->len; ++i) {
+        if (auto* stats = &g_array_index(pool->stats, CustomRtThreadStats, i); stats->tid == tid) {
+            return stats;
+        }
+    }
+    return nullptr;
 }
 
 static void
-defaultCleanup(GstTaskPool* pool)
+clearStats(gpointer data)
 {
-    g_message("Pool %p: cleanup", pool);
+    g_free(static_cast<CustomRtThreadStats*>(data)->element);
 }
 
-static gpointer
-defaultPush(GstTaskPool* pool, GstTaskPoolFunction func, gpointer data, GError** error)
+/* Account the calling worker thread with its own resource usage */
+static void
+updateOwnStats(CustomRtPool* pool, const gboolean alive)
 {
-    g_message("Pool %p: pushing %p", pool, func);
-    CustomRtId* tid = g_slice_new0(CustomRtId);
+    rusage usage{};
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        return;
+    }
 
-    g_message("Pool %p: set policy", pool);
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    if (const gint rv = pthread_attr_setschedpolicy(&attr, SCHED_RR); rv != 0) {
-        g_warning("Pool class %p: set policy has failed, %s", pool, g_strerror(rv));
+    g_mutex_lock(&pool->lock);
+    if (auto* stats = findStats(pool, currentTid()); stats != nullptr) {
+        stats->alive = alive;
+        stats->cpuTime = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * GST_SECOND
+                         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * GST_USECOND;
+        stats->voluntarySwitches = usage.ru_nvcsw;
+        stats->involuntarySwitches = usage.ru_nivcsw;
+        stats->minorFaults = usage.ru_minflt;
+        stats->majorFaults = usage.ru_majflt;
     }
+    g_mutex_unlock(&pool->lock);
+}
 
-    g_message("Pool %p: set priority", pool);
-    sched_param param{};
-    param.sched_priority = 50;
-    if (const gint rv = pthread_attr_setschedparam(&attr, &param); rv != 0) {
-        g_warning("Pool class %p: set priority has failed, %s", pool, g_strerror(rv));
+/* Account a running thread from the outside via procfs */
+static gboolean
+readProcStats(CustomRtThreadStats* stats)
+{
+    gchar* path = g_strdup_printf("/proc/self/task/%d/stat", stats->tid);
+    gchar* content{};
+    const gboolean ok = g_file_get_contents(path, &content, nullptr, nullptr);
+    g_free(path);
+    if (not ok) {
+        return FALSE;
+    }
+
+    /* Thread name may contain spaces, the fields follow the closing parenthesis */
+    if (const gchar* fields = strrchr(content, ')'); fields != nullptr) {
+        gchar** values = g_strsplit(fields + 2, " ", -1);
+        if (g_strv_length(values) > 12) {
+            static const guint64 ticks = sysconf(_SC_CLK_TCK);
+            /* minflt, majflt, utime and stime are 10, 12, 14 and 15 fields of stat */
+            stats->minorFaults = g_ascii_strtoull(values[7], nullptr, 10);
+            stats->majorFaults = g_ascii_strtoull(values[9], nullptr, 10);
+            stats->cpuTime = gst_util_uint64_scale(g_ascii_strtoull(values[11], nullptr, 10)
+                                                       + g_ascii_strtoull(values[12], nullptr, 10),
+                                                   GST_SECOND,
+                                                   ticks);
+        }
+        g_strfreev(values);
     }
+    g_free(content);
 
-    g_message("Pool %p: set inherit", pool);
-    if (const gint rv = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED); rv != 0) {
-        g_warning("Pool class %p: set inherit has failed, %s", pool, g_strerror(rv));
+    path = g_strdup_printf("/proc/self/task/%d/status", stats->tid);
+    if (g_file_get_contents(path, &content, nullptr, nullptr)) {
+        gchar** lines = g_strsplit(content, "\n", -1);
+        for (gchar** line = lines; *line != nullptr; ++line) {
+            if (g_str_has_prefix(*line, "voluntary_ctxt_switches:")) {
+                stats->voluntarySwitches = g_ascii_strtoull(strchr(*line, ':') + 1, nullptr, 10);
+            } else if (g_str_has_prefix(*line, "nonvoluntary_ctxt_switches:")) {
+                stats->involuntarySwitches = g_ascii_strtoull(strchr(*line, ':') + 1, nullptr, 10);
+            }
+        }
+        g_strfreev(lines);
+        g_free(content);
     }
+    g_free(path);
+    return TRUE;
+}
+
+/* Must be called with pool lock taken, workers of cleaned up pool are not listed */
+static gboolean
+isPoolWorker(CustomRtPool* pool)
+{
+    for (guint i = 0; i < pool->workers->len; ++i) {
+        if (pthread_equal(g_array_index(pool->workers, CustomRtWorker, i).thread, pthread_self())) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Worker owns a reference of the pool, released when it leaves */
+static gpointer
+workerRun(gpointer data)
+{
+    auto* pool = static_cast<CustomRtPool*>(data);
+
+    CustomRtThreadStats stats{};
+    stats.tid = currentTid();
+    stats.alive = TRUE;
+    g_mutex_lock(&pool->lock);
+    g_array_append_val(pool->stats, stats);
+    g_mutex_unlock(&pool->lock);
+
+    custom_rt_pool_apply_scheduling(pool, 0, 0);
+    while (true) {
+        auto* id = static_cast<CustomRtId*>(g_async_queue_pop(pool->jobs));
+        if (id == &stopJob) {
+            break;
+        }
+
+        id->func(id->data);
+
+        /**
+         * The pool is done with before completion, so push after join never spawns a
+         * thread for nothing and the joiner may drop the pool right away.
+         */
+        updateOwnStats(pool, TRUE);
+        g_mutex_lock(&pool->lock);
+        if (isPoolWorker(pool)) {
+            pool->idle++;
+        }
+        g_mutex_unlock(&pool->lock);
+
+        g_mutex_lock(&id->lock);
+        id->done = TRUE;
+        g_cond_signal(&id->cond);
+        g_mutex_unlock(&id->lock);
+    }
+
+    /* The procfs entry is gone with the thread, keep the final figures */
+    updateOwnStats(pool, FALSE);
+
+    /* The last reference may go here if the pool was cleaned up from this thread */
+    gst_object_unref(pool);
+    return nullptr;
+}
 
+/* Allocate thread stack with all pages resident and guard page at the bottom */
+static gpointer
+allocateStack(const gsize size)
+{
+    const auto page = static_cast<gsize>(sysconf(_SC_PAGESIZE));
+    void* area = mmap(nullptr,
+                      size + page,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_POPULATE,
+                      -1,
+                      0);
+    if (area == MAP_FAILED) {
+        return nullptr;
+    }
+    mprotect(area, page, PROT_NONE);
+    /* Touch every page, so no fault happens on the first use of the stack */
+    memset(static_cast<guint8*>(area) + page, 0, size);
+    return static_cast<guint8*>(area) + page;
+}
+
+static void
+freeStack(gpointer stack, const gsize size)
+{
+    const auto page = static_cast<gsize>(sysconf(_SC_PAGESIZE));
+    munmap(static_cast<guint8*>(stack) - page, size + page);
+}
+
+/* Must be called with pool lock taken */
+static gboolean
+spawnWorker(CustomRtPool* pool, GError** error)
+{
+    /**
+     * The thread is created with inherited scheduling, so creation never fails with EPERM.
+     * The worker picks the best available scheduling class itself when it starts.
+     */
     g_message("Pool %p: create thread", pool);
-    if (const gint rv = pthread_create(&tid->thread, &attr, (void* (*) (void*) ) func, data);
-        rv != 0) {
+    CustomRtWorker worker{};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (pool->determinism) {
+        worker.stackSize = pool->stackSize;
+        worker.stack = allocateStack(worker.stackSize);
+        if (worker.stack == nullptr) {
+            g_warning("Pool %p: allocate stack has failed, %s", pool, g_strerror(errno));
+        } else if (const gint rv = pthread_attr_setstack(&attr, worker.stack, worker.stackSize);
+                   rv != 0) {
+            g_warning("Pool %p: set stack has failed, %s", pool, g_strerror(rv));
+            freeStack(worker.stack, worker.stackSize);
+            worker.stack = nullptr;
+        }
+    }
+
+    /* Detached worker keeps using the pool after cleanup, the pool lives until it leaves */
+    const gint rv = pthread_create(&worker.thread, &attr, workerRun, gst_object_ref(pool));
+    pthread_attr_destroy(&attr);
+    if (rv != 0) {
+        gst_object_unref(pool);
         g_set_error(error,
                     G_THREAD_ERROR,
                     G_THREAD_ERROR_AGAIN,
                     "Error creating thread: %s",
                     g_strerror(rv));
-        g_slice_free(CustomRtId, tid);
-        tid = nullptr;
+        if (worker.stack != nullptr) {
+            freeStack(worker.stack, worker.stackSize);
+        }
+        return FALSE;
+    }
+
+    g_array_append_val(pool->workers, worker);
+    return TRUE;
+}
+
+static void
+defaultPrepare(GstTaskPool* pool, GError** error)
+{
+    auto* self = CUSTOM_RT_POOL_CAST(pool);
+    g_message("Pool %p: prepare %u threads", pool, self->threads);
+
+    if (self->determinism) {
+        /* Lock current and future mappings (heap, stacks, libraries) in memory */
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            g_warning("Pool %p: lock memory has failed, %s", pool, g_strerror(errno));
+        }
+    }
+
+    g_mutex_lock(&self->lock);
+    while (self->workers->len < self->threads) {
+        if (not spawnWorker(self, error)) {
+            break;
+        }
+        self->idle++;
+    }
+    g_mutex_unlock(&self->lock);
+}
+
+static void
+defaultCleanup(GstTaskPool* pool)
+{
+    auto* self = CUSTOM_RT_POOL_CAST(pool);
+    g_message("Pool %p: cleanup", pool);
+
+    g_mutex_lock(&self->lock);
+    GArray* workers = self->workers;
+    self->workers = g_array_new(FALSE, FALSE, sizeof(CustomRtWorker));
+    self->idle = 0;
+    g_mutex_unlock(&self->lock);
+
+    for (guint i = 0; i < workers->len; ++i) {
+        g_async_queue_push(self->jobs, &stopJob);
+    }
+    for (guint i = 0; i < workers->len; ++i) {
+        const auto& worker = g_array_index(workers, CustomRtWorker, i);
+        if (not pthread_equal(worker.thread, pthread_self())) {
+            pthread_join(worker.thread, nullptr);
+            if (worker.stack != nullptr) {
+                freeStack(worker.stack, worker.stackSize);
+            }
+        } else {
+            /* The last reference was dropped from the worker itself, its stack is leaked */
+            pthread_detach(worker.thread);
+        }
+    }
+    g_array_unref(workers);
+}
+
+static gpointer
+defaultPush(GstTaskPool* pool, GstTaskPoolFunction func, gpointer data, GError** error)
+{
+    auto* self = CUSTOM_RT_POOL_CAST(pool);
+    g_message("Pool %p: pushing %p", pool, func);
+
+    g_mutex_lock(&self->lock);
+    if (self->idle > 0) {
+        self->idle--;
+    } else {
+        /* All workers are busy running tasks, grow the pool by one */
+        if (not spawnWorker(self, error)) {
+            g_mutex_unlock(&self->lock);
+            return nullptr;
+        }
     }
-    return tid;
+    g_mutex_unlock(&self->lock);
+
+    CustomRtId* id = g_slice_new0(CustomRtId);
+    id->func = func;
+    id->data = data;
+    g_mutex_init(&id->lock);
+    g_cond_init(&id->cond);
+    g_async_queue_push(self->jobs, id);
+    return id;
 }
 
 static void
 defaultJoin(GstTaskPool* pool, gpointer id)
 {
-    if (auto* tid = static_cast<CustomRtId*>(id); tid != nullptr) {
+    if (auto* job = static_cast<CustomRtId*>(id); job != nullptr) {
         g_message("Pool %p: joining", pool);
-        pthread_join(tid->thread, nullptr);
-        g_slice_free(CustomRtId, tid);
+        g_mutex_lock(&job->lock);
+        while (not job->done) {
+            g_cond_wait(&job->cond, &job->lock);
+        }
+        g_mutex_unlock(&job->lock);
+
+        g_mutex_clear(&job->lock);
+        g_cond_clear(&job->cond);
+        g_slice_free(CustomRtId, job);
     }
 }
 
@@ -107,19 +453,241 @@ static void
 custom_rt_pool_init(CustomRtPool* pool)
 {
     g_message("Pool %p: init", pool);
+    g_mutex_init(&pool->lock);
+    pool->jobs = g_async_queue_new();
+    pool->workers = g_array_new(FALSE, FALSE, sizeof(CustomRtWorker));
+    pool->threads = CUSTOM_RT_POOL_DEFAULT_THREADS;
+    pool->idle = 0;
+    pool->policy = CUSTOM_RT_POOL_DEFAULT_POLICY;
+    pool->priority = CUSTOM_RT_POOL_DEFAULT_PRIORITY;
+    pool->load = CUSTOM_RT_POOL_DEFAULT_LOAD;
+    pool->stats = g_array_new(FALSE, TRUE, sizeof(CustomRtThreadStats));
+    g_array_set_clear_func(pool->stats, clearStats);
+    pool->determinism = FALSE;
+    pool->stackSize = CUSTOM_RT_POOL_DEFAULT_STACK_SIZE;
 }
 
 static void
 custom_rt_pool_finalize(GObject* object)
 {
     g_message("Pool %p: finalize", object);
+
+    /* Workers hold the pool, it is finalized only after cleanup has stopped all of them */
+    auto* pool = CUSTOM_RT_POOL_CAST(object);
+    g_warn_if_fail(pool->workers->len == 0);
+    g_array_unref(pool->workers);
+    g_array_unref(pool->stats);
+    g_async_queue_unref(pool->jobs);
+    g_mutex_clear(&pool->lock);
+
     G_OBJECT_CLASS(custom_rt_pool_parent_class)->finalize(object);
 }
 
 GstTaskPool*
 custom_rt_pool_new()
+{
+    return custom_rt_pool_new_full(CUSTOM_RT_POOL_DEFAULT_THREADS);
+}
+
+GstTaskPool*
+custom_rt_pool_new_full(guint threads)
 {
     auto* pool = static_cast<GstTaskPool*>(g_object_new(CUSTOM_TYPE_RT_POOL, nullptr));
+    CUSTOM_RT_POOL_CAST(pool)->threads = threads;
     g_message("Pool %p: new", pool);
     return pool;
 }
+
+gint
+custom_rt_pool_apply_scheduling(CustomRtPool* pool, gint fpsN, gint fpsD)
+{
+    g_return_val_if_fail(CUSTOM_IS_RT_POOL(pool), SCHED_OTHER);
+
+    g_mutex_lock(&pool->lock);
+    const guint load = pool->load;
+    const gint policy = pool->policy;
+    const gint priority = pool->priority;
+    g_mutex_unlock(&pool->lock);
+
+    /* Variable or unknown framerate, no budget could be derived */
+    if (fpsN > 0 and fpsD > 0) {
+        const guint64 period = gst_util_uint64_scale_int(GST_SECOND, fpsD, fpsN);
+        const guint64 runtime = period * load / 100;
+        g_message("Pool %p: deadline budget %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " ns",
+                  pool,
+                  runtime,
+                  period);
+        if (setDeadline(runtime, period)) {
+            g_message("Pool %p: thread runs with SCHED_DEADLINE", pool);
+            return SCHED_DEADLINE;
+        }
+    }
+    if (setRealtime(policy, priority)) {
+        g_message("Pool %p: thread runs with policy %d", pool, policy);
+        return policy;
+    }
+    const gint other = (policy == SCHED_RR) ? SCHED_FIFO : SCHED_RR;
+    if (setRealtime(other, priority)) {
+        g_message("Pool %p: thread runs with policy %d", pool, other);
+        return other;
+    }
+    setLowestNice();
+    g_message("Pool %p: thread runs with SCHED_OTHER", pool);
+    return SCHED_OTHER;
+}
+
+void
+custom_rt_pool_label_thread(CustomRtPool* pool, const gchar* element)
+{
+    g_return_if_fail(CUSTOM_IS_RT_POOL(pool));
+
+    g_mutex_lock(&pool->lock);
+    if (auto* stats = findStats(pool, currentTid()); stats != nullptr) {
+        g_free(stats->element);
+        stats->element = g_strdup(element);
+    }
+    g_mutex_unlock(&pool->lock);
+
+    /* Make the thread recognizable in "top -H" (name is limited to 15 chars) */
+    if (element != nullptr) {
+        const gchar* name = strrchr(element, '/');
+        gchar* shortName = g_strndup(name ? name + 1 : element, 15);
+        pthread_setname_np(pthread_self(), shortName);
+        g_free(shortName);
+    }
+}
+
+GArray*
+custom_rt_pool_snapshot(CustomRtPool* pool)
+{
+    g_return_val_if_fail(CUSTOM_IS_RT_POOL(pool), nullptr);
+
+    GArray* snapshot = g_array_new(FALSE, TRUE, sizeof(CustomRtThreadStats));
+    g_array_set_clear_func(snapshot, clearStats);
+
+    g_mutex_lock(&pool->lock);
+    for (guint i = 0; i < pool->stats->len; ++i) {
+        CustomRtThreadStats stats = g_array_index(pool->stats, CustomRtThreadStats, i);
+        stats.element = g_strdup(stats.element);
+        g_array_append_val(snapshot, stats);
+    }
+    g_mutex_unlock(&pool->lock);
+
+    /* Reading procfs is slow, do it outside of the lock */
+    for (guint i = 0; i < snapshot->len; ++i) {
+        if (auto* stats = &g_array_index(snapshot, CustomRtThreadStats, i); stats->alive) {
+            stats->alive = readProcStats(stats);
+        }
+    }
+    return snapshot;
+}
+
+typedef struct {
+    GWeakRef pool;
+    CustomRtSnapshotFunc func;
+    gpointer data;
+} CustomRtSnapshotWatch;
+
+static gboolean
+onSnapshotTimeout(gpointer data)
+{
+    auto* watch = static_cast<CustomRtSnapshotWatch*>(data);
+    auto* pool = static_cast<CustomRtPool*>(g_weak_ref_get(&watch->pool));
+    if (pool == nullptr) {
+        return G_SOURCE_REMOVE;
+    }
+    GArray* snapshot = custom_rt_pool_snapshot(pool);
+    watch->func(pool, snapshot, watch->data);
+    g_array_unref(snapshot);
+    gst_object_unref(pool);
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+freeSnapshotWatch(gpointer data)
+{
+    auto* watch = static_cast<CustomRtSnapshotWatch*>(data);
+    g_weak_ref_clear(&watch->pool);
+    g_free(watch);
+}
+
+guint
+custom_rt_pool_add_snapshot_watch(CustomRtPool* pool,
+                                  guint interval,
+                                  CustomRtSnapshotFunc func,
+                                  gpointer data)
+{
+    g_return_val_if_fail(CUSTOM_IS_RT_POOL(pool), 0);
+    g_return_val_if_fail(func != nullptr, 0);
+
+    auto* watch = g_new0(CustomRtSnapshotWatch, 1);
+    g_weak_ref_init(&watch->pool, pool);
+    watch->func = func;
+    watch->data = data;
+    return g_timeout_add_full(
+        G_PRIORITY_DEFAULT, interval, onSnapshotTimeout, watch, freeSnapshotWatch);
+}
+
+void
+custom_rt_pool_set_determinism(CustomRtPool* pool, gboolean enabled, gsize stackSize)
+{
+    g_return_if_fail(CUSTOM_IS_RT_POOL(pool));
+
+    const auto page = static_cast<gsize>(sysconf(_SC_PAGESIZE));
+    g_mutex_lock(&pool->lock);
+    pool->determinism = enabled;
+    if (stackSize > 0) {
+        /* Stack must be page aligned and not less than the minimum */
+        stackSize = MAX(stackSize, static_cast<gsize>(PTHREAD_STACK_MIN));
+        pool->stackSize = (stackSize + page - 1) / page * page;
+    }
+    g_mutex_unlock(&pool->lock);
+}
+
+void
+custom_rt_pool_mark_warmup(CustomRtPool* pool)
+{
+    g_return_if_fail(CUSTOM_IS_RT_POOL(pool));
+
+    GArray* snapshot = custom_rt_pool_snapshot(pool);
+    g_mutex_lock(&pool->lock);
+    for (guint i = 0; i < snapshot->len; ++i) {
+        const auto& current = g_array_index(snapshot, CustomRtThreadStats, i);
+        if (auto* stats = findStats(pool, current.tid); stats != nullptr) {
+            stats->warmMinorFaults = current.minorFaults;
+            stats->warmMajorFaults = current.majorFaults;
+            stats->warm = TRUE;
+        }
+    }
+    g_mutex_unlock(&pool->lock);
+    g_array_unref(snapshot);
+}
+
+guint64
+custom_rt_pool_check_faults(CustomRtPool* pool)
+{
+    g_return_val_if_fail(CUSTOM_IS_RT_POOL(pool), 0);
+
+    guint64 faults{};
+    GArray* snapshot = custom_rt_pool_snapshot(pool);
+    for (guint i = 0; i < snapshot->len; ++i) {
+        const auto& stats = g_array_index(snapshot, CustomRtThreadStats, i);
+        if (not stats.warm) {
+            continue;
+        }
+        const guint64 minor = stats.minorFaults - stats.warmMinorFaults;
+        const guint64 major = stats.majorFaults - stats.warmMajorFaults;
+        if (minor > 0 or major > 0) {
+            g_warning("Pool %p: thread %d (%s) faulted %" G_GUINT64_FORMAT
+                      " minor, %" G_GUINT64_FORMAT " major after warm-up",
+                      pool,
+                      stats.tid,
+                      stats.element ? stats.element : "<idle>",
+                      minor,
+                      major);
+        }
+        faults += minor + major;
+    }
+    g_array_unref(snapshot);
+    return faults;
+}
@@ -16,8 +16,13 @@
 
 #include <gst/gst.h>
 
+#include <sched.h>
+
 G_BEGIN_DECLS
 
+typedef struct CustomRtPool CustomRtPool;
+typedef struct CustomRtPoolClass CustomRtPoolClass;
+
 // clang-format off
 #define CUSTOM_TYPE_RT_POOL             (custom_rt_pool_get_type())
 #define CUSTOM_RT_POOL(pool)            (G_TYPE_CHECK_INSTANCE_CAST((pool), CUSTOM_TYPE_RT_POOL, CustomRtPool))
@@ -28,8 +33,48 @@ G_BEGIN_DECLS
 #define CUSTOM_RT_POOL_CAST(pool)       ((CustomRtPool*)(pool))
 // clang-format on
 
+/* Number of worker threads spawned by default on prepare */
+#define CUSTOM_RT_POOL_DEFAULT_THREADS 2
+/* Real-time policy and priority tried when no deadline budget is set */
+#define CUSTOM_RT_POOL_DEFAULT_POLICY SCHED_RR
+#define CUSTOM_RT_POOL_DEFAULT_PRIORITY 50
+/* Share of the frame period reserved as SCHED_DEADLINE runtime (percents) */
+#define CUSTOM_RT_POOL_DEFAULT_LOAD 50
+/* Size of prefaulted worker stack in determinism mode */
+#define CUSTOM_RT_POOL_DEFAULT_STACK_SIZE (512 * 1024)
+
+/* Accounting of one worker thread */
+typedef struct {
+    gint tid;
+    gchar* element;
+    gboolean alive;
+    guint64 cpuTime;
+    guint64 voluntarySwitches;
+    guint64 involuntarySwitches;
+    guint64 minorFaults;
+    guint64 majorFaults;
+    gboolean warm;
+    guint64 warmMinorFaults;
+    guint64 warmMajorFaults;
+} CustomRtThreadStats;
+
+typedef void (*CustomRtSnapshotFunc)(CustomRtPool* pool, GArray* stats, gpointer data);
+
 struct CustomRtPool {
     GstTaskPool object;
+
+    /*< private >*/
+    GMutex lock;
+    GAsyncQueue* jobs;
+    GArray* workers;
+    guint threads;
+    guint idle;
+    gint policy;
+    gint priority;
+    guint load;
+    GArray* stats;
+    gboolean determinism;
+    gsize stackSize;
 };
 
 struct CustomRtPoolClass {
@@ -38,7 +83,53 @@ struct CustomRtPoolClass {
 
 GType
 custom_rt_pool_get_type(void);
+/* Workers hold the pool until gst_task_pool_cleanup() stops them */
 GstTaskPool*
 custom_rt_pool_new(void);
+GstTaskPool*
+custom_rt_pool_new_full(guint threads);
+
+/**
+ * Apply the best available scheduling class to the calling thread:
+ * SCHED_DEADLINE (if framerate of the task run by the thread is known, 0/0 otherwise),
+ * then SCHED_RR/FIFO, then SCHED_OTHER with the lowest allowed nice value. Deadline
+ * runtime and period are derived for the calling thread only, tasks sharing the pool
+ * keep their own budgets. Returns the applied policy.
+ */
+gint
+custom_rt_pool_apply_scheduling(CustomRtPool* pool, gint fpsN, gint fpsD);
+
+/* Label the calling worker thread with the path of the element owning the task */
+void
+custom_rt_pool_label_thread(CustomRtPool* pool, const gchar* element);
+
+/**
+ * Take the accounting snapshot of all worker threads ever created by the pool
+ * (array of CustomRtThreadStats, free with g_array_unref)
+ */
+GArray*
+custom_rt_pool_snapshot(CustomRtPool* pool);
+
+/**
+ * Enable "RT determinism" mode (must be set before prepare): lock all process memory
+ * with mlockall() and run workers on prefaulted stacks of the given size (0 - default)
+ */
+void
+custom_rt_pool_set_determinism(CustomRtPool* pool, gboolean enabled, gsize stackSize);
+
+/* Remember fault counters of all threads as the end of warm-up */
+void
+custom_rt_pool_mark_warmup(CustomRtPool* pool);
+
+/* Return the number of faults since warm-up (warns about faulting threads) */
+guint64
+custom_rt_pool_check_faults(CustomRtPool* pool);
+
+/* Call the function with a new snapshot every interval until the pool is gone */
+guint
+custom_rt_pool_add_snapshot_watch(CustomRtPool* pool,
+                                  guint interval,
+                                  CustomRtSnapshotFunc func,
+                                  gpointer data);
 
 G_END_DECLS
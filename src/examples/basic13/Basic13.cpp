@@ -12,12 +12,35 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "common/MediaCache.hpp"
+#include "common/TypeFind.hpp"
+
 #include <gst/gst.h>
 
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
 /**
  * Example 13: Identifying media type using typefind gstreamer element
+ *  + batch mode: typefinding directory tree with a pool of reusable pipelines
+ *  + batch mode: typefinding from mapped file header, pipeline only for inconclusive result
+ *  + bench mode: comparing throughput of both ways
+ *  + persistent cache: unchanged files are not typefound again
  **/
 
+namespace fs = std::filesystem;
+
+static gchar* batchDir{};
+static gint jobs{};
+static gboolean bench{};
+static gchar* cachePath{};
+
 static void
 onPipelineError(GstBus* /*bus*/, GstMessage* message, gpointer data)
 {
@@ -61,17 +84,277 @@ onTypeFound(GstElement* /*typefind*/, const guint probability, GstCaps* caps, gp
     g_idle_add(idle_exit_loop, mainLoop);
 }
 
+/* Source of files shared by batch workers */
+class FileWalker {
+public:
+    explicit FileWalker(const fs::path& root)
+        : _it{root, fs::directory_options::skip_permission_denied, _error}
+    {
+    }
+
+    std::optional<fs::path>
+    next()
+    {
+        std::lock_guard lock{_guard};
+        for (; _it != fs::recursive_directory_iterator{}; _it.increment(_error)) {
+            if (_error) {
+                g_printerr("Walking error: %s\n", _error.message().c_str());
+                _error.clear();
+                continue;
+            }
+            if (_it->is_regular_file(_error)) {
+                fs::path path = _it->path();
+                _it.increment(_error);
+                return path;
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    std::mutex _guard;
+    std::error_code _error;
+    fs::recursive_directory_iterator _it;
+};
+
+using NextFile = std::function<std::optional<fs::path>()>;
+
+enum class Method { Header, Pipeline };
+
+/* Returns caps from the cache or found by the given method, unref after usage */
+static GstCaps*
+typefindCached(const fs::path& path,
+               const Method method,
+               TypeFinder& finder,
+               MediaCache* cache,
+               GstTypeFindProbability* probability)
+{
+    std::optional<MediaCacheKey> key;
+    if (cache != nullptr and (key = MediaCache::keyOf(path))) {
+        if (auto entry = cache->lookup(*key)) {
+            *probability = static_cast<GstTypeFindProbability>(entry->probability);
+            return entry->caps.empty() ? nullptr : gst_caps_from_string(entry->caps.c_str());
+        }
+    }
+
+    GstCaps* caps = (method == Method::Header) ? typeFindFile(path, probability, &finder)
+                                               : finder.find(path, probability);
+    if (key) {
+        /* Unknown type is cached too, otherwise it is the most expensive file every time */
+        MediaCacheEntry entry{static_cast<guint>(*probability)};
+        if (caps != nullptr) {
+            gchar* str = gst_caps_to_string(caps);
+            entry.caps = str;
+            g_free(str);
+        }
+        cache->store(*key, std::move(entry));
+    }
+    return caps;
+}
+
+/* Worker of batch mode, pipeline is created once and reused for every file */
+static void
+typefindBatch(const NextFile& next, const Method method, MediaCache* cache, const gboolean print)
+{
+    TypeFinder finder;
+    while (const auto path = next()) {
+        GstTypeFindProbability probability{GST_TYPE_FIND_NONE};
+        GstCaps* caps = typefindCached(*path, method, finder, cache, &probability);
+        if (print) {
+            const gchar* mime = "unknown";
+            if (caps != nullptr and not gst_caps_is_empty(caps)) {
+                mime = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+            }
+            g_print("%s\t%s\t%u\n", path->c_str(), mime, probability);
+        }
+        if (caps != nullptr) {
+            gst_caps_unref(caps);
+        }
+    }
+}
+
+static void
+runWorkers(const NextFile& next,
+           const Method method,
+           MediaCache* cache,
+           const gboolean print,
+           const guint workers)
+{
+    std::vector<std::thread> threads;
+    for (guint i = 0; i < workers; ++i) {
+        threads.emplace_back(typefindBatch, std::cref(next), method, cache, print);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/* Returns the cache of --cache option or nullptr */
+static std::unique_ptr<MediaCache>
+openCache()
+{
+    std::unique_ptr<MediaCache> cache;
+    if (cachePath != nullptr) {
+        GError* error{};
+        cache = std::make_unique<MediaCache>(cachePath);
+        if (not cache->open(&error)) {
+            g_printerr("Cache is ignored: %s\n", error->message);
+            g_clear_error(&error);
+        }
+    }
+    return cache;
+}
+
+static void
+saveCache(MediaCache* cache)
+{
+    GError* error{};
+    if (cache != nullptr and not cache->flush(&error)) {
+        g_printerr("Unable to save cache: %s\n", error->message);
+        g_clear_error(&error);
+    }
+}
+
+static int
+runBatch(const fs::path& root, const guint workers)
+{
+    std::error_code error;
+    if (not fs::is_directory(root, error)) {
+        g_printerr("Not a directory: %s\n", root.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<MediaCache> cache = openCache();
+    FileWalker walker{root};
+    runWorkers([&walker]() { return walker.next(); }, Method::Header, cache.get(), TRUE, workers);
+    saveCache(cache.get());
+    return EXIT_SUCCESS;
+}
+
+/* Single file with the cache, the pipeline is built only if the file is not cached */
+static int
+runCached(const fs::path& path)
+{
+    std::unique_ptr<MediaCache> cache = openCache();
+    TypeFinder finder;
+    GstTypeFindProbability probability{GST_TYPE_FIND_NONE};
+    GstCaps* caps = typefindCached(path, Method::Pipeline, finder, cache.get(), &probability);
+    if (caps != nullptr and not gst_caps_is_empty(caps)) {
+        gchar* type = gst_caps_to_string(caps);
+        g_print("Media type %s found, probability %d%%\n", type, probability);
+        g_free(type);
+    } else {
+        g_print("Media type is unknown\n");
+    }
+    if (caps != nullptr) {
+        gst_caps_unref(caps);
+    }
+    saveCache(cache.get());
+    return EXIT_SUCCESS;
+}
+
+/* Compares files/s of header typefinding (with fallback) against pipeline per file */
+static int
+runBench(const fs::path& root, const guint workers)
+{
+    std::error_code error;
+    if (not fs::is_directory(root, error)) {
+        g_printerr("Not a directory: %s\n", root.c_str());
+        return EXIT_FAILURE;
+    }
+
+    /* Both passes see the same warm list, directory walking is not measured */
+    std::vector<fs::path> files;
+    FileWalker walker{root};
+    while (auto path = walker.next()) {
+        files.push_back(std::move(*path));
+    }
+    if (files.empty()) {
+        g_printerr("No files found: %s\n", root.c_str());
+        return EXIT_FAILURE;
+    }
+
+    g_print("files: %zu, workers: %u\n", files.size(), workers);
+    g_print("%-10s %12s %12s\n", "method", "seconds", "files/s");
+    for (const Method method : {Method::Pipeline, Method::Header}) {
+        std::atomic_size_t index{0};
+        const NextFile next = [&files, &index]() -> std::optional<fs::path> {
+            if (const gsize i = index++; i < files.size()) {
+                return files[i];
+            }
+            return std::nullopt;
+        };
+
+        const gint64 begin = g_get_monotonic_time();
+        runWorkers(next, method, nullptr, FALSE, workers);
+        const gdouble seconds = (g_get_monotonic_time() - begin) / gdouble(G_USEC_PER_SEC);
+        g_print("%-10s %12.3f %12.1f\n",
+                method == Method::Header ? "header" : "pipeline",
+                seconds,
+                files.size() / seconds);
+    }
+    return EXIT_SUCCESS;
+}
+
 int
 main(int argc, char* argv[])
 {
+    GOptionEntry options[] = {{"batch",
+                               'b',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &batchDir,
+                               "Typefind every file in the directory tree",
+                               nullptr},
+                              {"jobs",
+                               'j',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &jobs,
+                               "Number of concurrent pipelines in batch mode (0 - CPU count)",
+                               nullptr},
+                              {"bench",
+                               0,
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &bench,
+                               "Compare files/s of header and pipeline typefinding in batch mode",
+                               nullptr},
+                              {"cache",
+                               0,
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &cachePath,
+                               "Typefind results cache file",
+                               nullptr},
+                              {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("<filename>");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
     // Initialize GStreamer
-    gst_init(&argc, &argv);
+    GError* err{};
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        g_printerr("Error initializing: %s\n", err->message);
+        g_clear_error(&err);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    if (batchDir != nullptr) {
+        const guint workers = jobs > 0 ? jobs : g_get_num_processors();
+        return bench ? runBench(batchDir, workers) : runBatch(batchDir, workers);
+    }
 
     // Check args
     if (argc != 2) {
         g_print("Usage: %s <filename>\n", argv[0]);
         return EXIT_FAILURE;
     }
+    if (cachePath != nullptr) {
+        return runCached(argv[1]);
+    }
 
     GMainLoop* mainLoop = g_main_loop_new(nullptr, FALSE);
     g_assert(mainLoop);
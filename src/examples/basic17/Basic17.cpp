@@ -12,78 +12,376 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <gst/app/gstappsink.h>
 #include <gst/gst.h>
-#ifdef HAVE_GTK
-#include <gtk/gtk.h>
-#endif
+#include <gst/video/video.h>
 
 /**
  * Example 17: Using "appsink" to pull frames from pipeline
+ *  + batch mode: thumbnails of URI list by a pool of pipelines reused across files
+ *  + fast mode: key unit trick mode seek, decoders skip everything but keyframes
+ *  + black and flat frames are detected, snapshot is taken a few seconds later
+ *  + sprite sheet: one preroll, frames of ordered seeks composited into one image
+ *  + live sources: the freshest frame is pulled in PLAYING within the timeout
+ *  + images (PPM, PNG or JPEG) are encoded off the pipeline thread
  */
 
+#include "common/FrameStats.hpp"
+#include "common/ImageWriter.hpp"
+#include "common/Utils.hpp"
+
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
 
 #define CAPS "video/x-raw,format=RGB,width=160,pixel-aspect-ratio=1/1"
 
-int
-main(int argc, char* argv[])
+static gchar* batchList{};
+static gint jobs{};
+static gchar* outputDir{};
+static gint timeout{5};
+static gboolean fast{};
+static gboolean bench{};
+static gdouble blankStep{2.0};
+static gint blankRetries{3};
+static gint spriteFrames{};
+static gint spriteColumns{10};
+static gchar* imageFormat{};
+
+static const gchar* const kImageFormats[] = {"ppm", "png", "jpg", "jpeg", nullptr};
+
+/* Frame is black when most samples are dark, flat when luma deviation is below ~6 */
+static constexpr gdouble kBlackRatio{0.95};
+static constexpr gdouble kFlatVariance{36.0};
+
+/* Pipeline "uridecodebin ! videoconvert ! videoscale ! appsink" created once per worker */
+struct Thumbnailer {
+    GstElement* pipeline{};
+    GstElement* decoder{};
+    GstElement* convert{};
+    GstElement* sink{};
+    GstBus* bus{};
+};
+
+/* Details of a snapshot for reports */
+struct SnapshotInfo {
+    guint reseeks{};
+    /* Time spent in the frame statistics (us) */
+    gint64 statsTime{};
+    /* Time from the request to the frame of live source (us), -1 if not live */
+    gint64 latency{-1};
+};
+
+/* Frames laid out row by row in one RGB image, allocated once the frame size is known */
+struct Atlas {
+    gint columns{};
+    gint rows{};
+    gint cellWidth{};
+    gint cellHeight{};
+    gsize stride{};
+    std::vector<guint8> pixels;
+};
+
+/* URI list shared by the batch workers */
+struct UriQueue {
+    GPtrArray* uris{};
+    std::atomic_uint next{};
+};
+
+/* Decoder pads appear for each file again, video one is linked, others are left alone */
+static void
+onPadAdded(GstElement* /*decoder*/, GstPad* pad, gpointer data)
 {
-    /* Initialize GStreamer */
-    gst_init(&argc, &argv);
+    auto* thumbnailer = static_cast<Thumbnailer*>(data);
 
-    if (argc != 2) {
-        g_print("usage: %s <uri>\n Writes snapshot.png in the current directory\n", argv[0]);
-        return EXIT_FAILURE;
+    GstPad* sinkPad = gst_element_get_static_pad(thumbnailer->convert, "sink");
+    if (not gst_pad_is_linked(sinkPad)) {
+        GstCaps* caps = gst_pad_get_current_caps(pad);
+        if (caps == nullptr) {
+            caps = gst_pad_query_caps(pad, nullptr);
+        }
+        const GstStructure* s = gst_caps_get_structure(caps, 0);
+        if (s != nullptr and g_str_has_prefix(gst_structure_get_name(s), "video/")) {
+            gst_pad_link(pad, sinkPad);
+        }
+        gst_caps_unref(caps);
     }
+    gst_object_unref(sinkPad);
+}
 
-    /* Create a new pipeline */
-    GError* error{};
-    gchar* descr = g_strdup_printf("uridecodebin uri=%s ! videoconvert ! videoscale ! "
-                                   " appsink name=sink caps=\"" CAPS "\"",
-                                   argv[1]);
-    GstElement* pipeline = gst_parse_launch(descr, &error);
-    if (error != nullptr) {
-        g_print("could not construct pipeline: %s\n", error->message);
-        g_clear_error(&error);
-        return EXIT_FAILURE;
+static Thumbnailer*
+createThumbnailer()
+{
+    auto* thumbnailer = new Thumbnailer;
+    thumbnailer->pipeline = gst_pipeline_new(nullptr);
+    thumbnailer->decoder = gst_element_factory_make("uridecodebin", nullptr);
+    thumbnailer->convert = gst_element_factory_make("videoconvert", nullptr);
+    GstElement* scale = gst_element_factory_make("videoscale", nullptr);
+    thumbnailer->sink = gst_element_factory_make("appsink", nullptr);
+    g_assert(thumbnailer->pipeline and thumbnailer->decoder and thumbnailer->convert and scale
+             and thumbnailer->sink);
+
+    GstCaps* caps = gst_caps_from_string(CAPS);
+    /**
+     * Live source doesn't preroll, frames flow in PLAYING. Only the last frame is kept,
+     * so a pulled one is never older than one frame interval. Preroll is not affected.
+     */
+    g_object_set(thumbnailer->sink, "caps", caps, "max-buffers", 1, "drop", TRUE, NULL);
+    gst_caps_unref(caps);
+
+    gst_bin_add_many(GST_BIN(thumbnailer->pipeline),
+                     thumbnailer->decoder,
+                     thumbnailer->convert,
+                     scale,
+                     thumbnailer->sink,
+                     NULL);
+    gst_element_link_many(thumbnailer->convert, scale, thumbnailer->sink, NULL);
+    g_signal_connect(thumbnailer->decoder, "pad-added", G_CALLBACK(onPadAdded), thumbnailer);
+
+    thumbnailer->bus = gst_element_get_bus(thumbnailer->pipeline);
+    return thumbnailer;
+}
+
+static void
+destroyThumbnailer(Thumbnailer* thumbnailer)
+{
+    gst_element_set_state(thumbnailer->pipeline, GST_STATE_NULL);
+    gst_object_unref(thumbnailer->bus);
+    gst_object_unref(thumbnailer->pipeline);
+    delete thumbnailer;
+}
+
+/* Wait for preroll (or seek) to complete, pipeline errors are returned */
+static gboolean
+waitAsyncDone(Thumbnailer& thumbnailer, GError** error)
+{
+    GstMessage* msg
+        = gst_bus_timed_pop_filtered(thumbnailer.bus,
+                                     timeout * GST_SECOND,
+                                     GstMessageType(GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR));
+    if (msg == nullptr) {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE, "Preroll timed out");
+        return FALSE;
+    }
+    const gboolean ok = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ASYNC_DONE);
+    if (not ok) {
+        gst_message_parse_error(msg, error, nullptr);
+    }
+    gst_message_unref(msg);
+    return ok;
+}
+
+/**
+ * Normal seek decodes from the keyframe and may decode a few more frames on the way.
+ * Trick mode segment makes video decoders drop everything but keyframes, so a single
+ * decoded frame is enough to preroll.
+ */
+static GstSeekFlags
+seekFlags(const gboolean keyframesOnly)
+{
+    if (keyframesOnly) {
+        return static_cast<GstSeekFlags>(GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_FLUSH
+                                         | GST_SEEK_FLAG_TRICKMODE
+                                         | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS
+                                         | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO);
     }
+    return static_cast<GstSeekFlags>(GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_FLUSH);
+}
 
-    /* get sink */
-    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+/* Map the sample, strides come from the buffer video meta or the caps defaults */
+static gboolean
+mapFrame(GstSample* sample, GstVideoFrame& frame)
+{
+    GstVideoInfo info;
+    return gst_video_info_from_caps(&info, gst_sample_get_caps(sample))
+           and gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample), GST_MAP_READ);
+}
 
-    /* set to PAUSED to make the first frame arrive in the sink */
-    GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PAUSED);
-    switch (ret) {
-    case GST_STATE_CHANGE_FAILURE: {
-        g_print("Failed to play the file\n");
-        return EXIT_FAILURE;
+static gboolean
+sampleStats(GstSample* sample, FrameStats& stats)
+{
+    GstVideoFrame frame;
+    if (not mapFrame(sample, frame)) {
+        return FALSE;
     }
-    case GST_STATE_CHANGE_NO_PREROLL: {
-        /**
-         * For live sources, we need to set the pipeline to PLAYING before we can
-         * receive a buffer. We don't do that yet
-         */
-        g_print("live sources not supported yet\n");
-        return EXIT_FAILURE;
+    stats = computeRgbStats(static_cast<const guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0)),
+                            GST_VIDEO_FRAME_WIDTH(&frame),
+                            GST_VIDEO_FRAME_HEIGHT(&frame),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0));
+    gst_video_frame_unmap(&frame);
+    return TRUE;
+}
+
+/* Statistics of the sample, time spent is accounted in the snapshot details */
+static gboolean
+measureSample(GstSample* sample, FrameStats& stats, SnapshotInfo* info)
+{
+    const gint64 begin = g_get_monotonic_time();
+    const gboolean ok = sampleStats(sample, stats);
+    if (info != nullptr) {
+        info->statsTime += g_get_monotonic_time() - begin;
     }
+    return ok;
+}
+
+static gboolean
+isBlankFrame(const FrameStats& stats)
+{
+    return stats.darkRatio > kBlackRatio or stats.variance < kFlatVariance;
+}
+
+/**
+ * Seek a step further while the frame is black or flat (fades, title cards). When
+ * every retry is blank too the most detailed frame is kept, failed re-seek keeps
+ * what we have.
+ */
+static GstSample*
+skipBlankFrames(Thumbnailer& thumbnailer,
+                GstSample* sample,
+                gint64 position,
+                const gint64 duration,
+                const gboolean keyframesOnly,
+                SnapshotInfo* info)
+{
+    FrameStats stats;
+    if (not measureSample(sample, stats, info) or not isBlankFrame(stats)) {
+        return sample;
+    }
+
+    for (gint retry = 0; retry < blankRetries; ++retry) {
+        position += gint64(blankStep * GST_SECOND);
+        if ((duration != -1 and position >= duration)
+            or not gst_element_seek_simple(
+                thumbnailer.pipeline, GST_FORMAT_TIME, seekFlags(keyframesOnly), position)
+            or not waitAsyncDone(thumbnailer, nullptr)) {
+            break;
+        }
+
+        GstSample* next{};
+        g_signal_emit_by_name(thumbnailer.sink, "pull-preroll", &next, NULL);
+        if (next == nullptr) {
+            break;
+        }
+        if (info != nullptr) {
+            info->reseeks++;
+        }
+
+        FrameStats nextStats;
+        const gboolean found
+            = not measureSample(next, nextStats, info) or not isBlankFrame(nextStats);
+        if (found or nextStats.variance > stats.variance) {
+            gst_sample_unref(sample);
+            sample = next;
+            stats = nextStats;
+        } else {
+            gst_sample_unref(next);
+        }
+        if (found) {
+            break;
+        }
+    }
+    return sample;
+}
+
+/* Open the uri on the existing pipeline and wait for the first frame, live one goes PLAYING */
+static gboolean
+preroll(Thumbnailer& thumbnailer, const gchar* uri, gboolean& live, GError** error)
+{
+    /* Elements are kept, only the uri is changed in READY state */
+    gst_element_set_state(thumbnailer.pipeline, GST_STATE_READY);
+    gst_bus_set_flushing(thumbnailer.bus, TRUE);
+    gst_bus_set_flushing(thumbnailer.bus, FALSE);
+    g_object_set(thumbnailer.decoder, "uri", uri, NULL);
+
+    /* set to PAUSED to make the first frame arrive in the sink */
+    switch (gst_element_set_state(thumbnailer.pipeline, GST_STATE_PAUSED)) {
+    case GST_STATE_CHANGE_FAILURE:
+        /* The reason is posted on the bus */
+        waitAsyncDone(thumbnailer, error);
+        if (error != nullptr and *error == nullptr) {
+            g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE, "Failed to pause");
+        }
+        return FALSE;
+    case GST_STATE_CHANGE_NO_PREROLL:
+        live = TRUE;
+        if (gst_element_set_state(thumbnailer.pipeline, GST_STATE_PLAYING)
+            == GST_STATE_CHANGE_FAILURE) {
+            waitAsyncDone(thumbnailer, error);
+            if (error != nullptr and *error == nullptr) {
+                g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE, "Failed to play");
+            }
+            return FALSE;
+        }
+        return TRUE;
     default:
         break;
     }
+    live = FALSE;
+    return waitAsyncDone(thumbnailer, error);
+}
 
-    /**
-     * This can block for up to 5 seconds. If your machine is really overloaded,
-     * it might time out before the pipeline prerolled and we generate an error. A
-     * better way is to run a mainloop and catch errors there.
-     */
-    ret = gst_element_get_state(pipeline, nullptr, nullptr, 5 * GST_SECOND);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        g_print("failed to play the file\n");
-        return EXIT_FAILURE;
+/**
+ * Pull the next frame of live source before the deadline. Source is stopped afterwards,
+ * so the next request doesn't get a frame queued long ago.
+ */
+static GstSample*
+pullLive(Thumbnailer& thumbnailer, const gint64 requested, GError** error)
+{
+    const gint64 deadline = requested + timeout * G_TIME_SPAN_SECOND;
+    GstSample* sample{};
+    for (gint64 now = g_get_monotonic_time(); sample == nullptr and now < deadline;
+         now = g_get_monotonic_time()) {
+        sample = gst_app_sink_try_pull_sample(GST_APP_SINK(thumbnailer.sink),
+                                              (deadline - now) * GST_USECOND);
+        if (sample == nullptr and gst_app_sink_is_eos(GST_APP_SINK(thumbnailer.sink))) {
+            break;
+        }
+    }
+
+    if (sample == nullptr) {
+        /* Pipeline error is more telling than the timeout */
+        GstMessage* msg = gst_bus_pop_filtered(thumbnailer.bus, GST_MESSAGE_ERROR);
+        if (msg != nullptr) {
+            gst_message_parse_error(msg, error, nullptr);
+            gst_message_unref(msg);
+        } else {
+            g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "No live frame");
+        }
+    }
+    gst_element_set_state(thumbnailer.pipeline, GST_STATE_READY);
+    return sample;
+}
+
+/* Returns the frame at 5% of the duration (unref after usage) or nullptr */
+static GstSample*
+snapshot(Thumbnailer& thumbnailer,
+         const gchar* uri,
+         const gboolean keyframesOnly,
+         GError** error,
+         SnapshotInfo* info = nullptr)
+{
+    const gint64 requested = g_get_monotonic_time();
+    gboolean live{};
+    if (not preroll(thumbnailer, uri, live, error)) {
+        return nullptr;
+    }
+    if (live) {
+        /* Nothing to seek in, blank frames are not skipped */
+        GstSample* sample = pullLive(thumbnailer, requested, error);
+        if (sample != nullptr and info != nullptr) {
+            info->latency = g_get_monotonic_time() - requested;
+        }
+        return sample;
     }
 
     /* Get the duration */
-    gint64 duration, position;
-    gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration);
+    gint64 duration{-1}, position;
+    gst_element_query_duration(thumbnailer.pipeline, GST_FORMAT_TIME, &duration);
     if (duration != -1)
         /* We have a duration, seek to 5% */
         position = duration * 5 / 100;
@@ -94,81 +392,507 @@ main(int argc, char* argv[])
     /**
      * Seek to the position in the file. Most files have a black first frame so
      * by seeking to somewhere else we have a bigger chance of getting something
-     * more interesting. An optimisation would be to detect black images and then
-     * seek a little more
+     * more interesting. Not seekable stream gives the first frame.
      */
-    gst_element_seek_simple(pipeline,
-                            GST_FORMAT_TIME,
-                            static_cast<GstSeekFlags>(GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_FLUSH),
-                            position);
+    if (gst_element_seek_simple(
+            thumbnailer.pipeline, GST_FORMAT_TIME, seekFlags(keyframesOnly), position)
+        and not waitAsyncDone(thumbnailer, error)) {
+        return nullptr;
+    }
 
-    /**
-     * Get the preroll buffer from appsink, this block untils appsink really
-     * prerolls
-     */
+    /* Get the preroll buffer from appsink */
     GstSample* sample{};
-    g_signal_emit_by_name(sink, "pull-preroll", &sample, NULL);
+    g_signal_emit_by_name(thumbnailer.sink, "pull-preroll", &sample, NULL);
+    if (sample == nullptr) {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "No frame");
+        return nullptr;
+    }
+    return skipBlankFrames(thumbnailer, sample, position, duration, keyframesOnly, info);
+}
 
-    /**
-     * If we have a buffer now, convert it to a pixbuf. It's possible that we
-     * don't have a buffer because we went EOS right away or had an error.
-     */
+/* Copy the frame into its cell, the atlas is allocated by the first frame */
+static gboolean
+compositeFrame(Atlas& atlas, GstSample* sample, const guint index, GError** error)
+{
+    GstVideoFrame frame;
+    if (not mapFrame(sample, frame)) {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "Unable to map frame");
+        return FALSE;
+    }
+    const gint width = GST_VIDEO_FRAME_WIDTH(&frame);
+    const gint height = GST_VIDEO_FRAME_HEIGHT(&frame);
+    const gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+    const auto* data = static_cast<const guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0));
+    if (atlas.pixels.empty()) {
+        atlas.cellWidth = width;
+        atlas.cellHeight = height;
+        atlas.stride = GST_ROUND_UP_4(gsize(atlas.columns) * width * 3);
+        atlas.pixels.assign(atlas.stride * atlas.rows * height, 0);
+    }
+
+    /* Resolution change mid-stream is clipped to the cell */
+    const gsize rowSize = gsize(MIN(width, atlas.cellWidth)) * 3;
+    const gint rows = MIN(height, atlas.cellHeight);
+    const gsize offset = (index / atlas.columns) * atlas.cellHeight * atlas.stride
+                         + (index % atlas.columns) * atlas.cellWidth * 3;
+    guint8* cell = atlas.pixels.data() + offset;
+    for (gint row = 0; row < rows; ++row) {
+        memcpy(cell + row * atlas.stride, data + row * stride, rowSize);
+    }
+    gst_video_frame_unmap(&frame);
+    return TRUE;
+}
+
+/* Wrap the atlas (without copy) as RGB sample, it must outlive the sample */
+static GstSample*
+atlasSample(Atlas& atlas)
+{
+    const gint width = atlas.columns * atlas.cellWidth;
+    const gint height = atlas.rows * atlas.cellHeight;
+    GstBuffer* buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                    atlas.pixels.data(),
+                                                    atlas.pixels.size(),
+                                                    0,
+                                                    atlas.pixels.size(),
+                                                    nullptr,
+                                                    nullptr);
+    gsize offsets[GST_VIDEO_MAX_PLANES] = {0};
+    gint strides[GST_VIDEO_MAX_PLANES] = {gint(atlas.stride)};
+    gst_buffer_add_video_meta_full(buffer,
+                                   GST_VIDEO_FRAME_FLAG_NONE,
+                                   GST_VIDEO_FORMAT_RGB,
+                                   width,
+                                   height,
+                                   1,
+                                   offsets,
+                                   strides);
+
+    GstCaps* caps = gst_caps_new_simple("video/x-raw",
+                                        "format",
+                                        G_TYPE_STRING,
+                                        "RGB",
+                                        "width",
+                                        G_TYPE_INT,
+                                        width,
+                                        "height",
+                                        G_TYPE_INT,
+                                        height,
+                                        "framerate",
+                                        GST_TYPE_FRACTION,
+                                        0,
+                                        1,
+                                        "pixel-aspect-ratio",
+                                        GST_TYPE_FRACTION,
+                                        1,
+                                        1,
+                                        NULL);
+    GstSample* sample = gst_sample_new(buffer, caps, nullptr, nullptr);
+    gst_caps_unref(caps);
+    gst_buffer_unref(buffer);
+    return sample;
+}
+
+/**
+ * Sprite sheet of frames evenly spaced over the duration. The file is prerolled once,
+ * then each position costs one flushing seek on the same pipeline. Positions go in
+ * increasing order, so demuxers read the file forward. The atlas is encoded once.
+ */
+static gboolean
+spriteSheet(Thumbnailer& thumbnailer,
+            const gchar* uri,
+            const guint count,
+            const gboolean keyframesOnly,
+            const gchar* path,
+            GError** error)
+{
+    gboolean live{};
+    if (not preroll(thumbnailer, uri, live, error)) {
+        return FALSE;
+    }
+    if (live) {
+        gst_element_set_state(thumbnailer.pipeline, GST_STATE_READY);
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_NOT_IMPLEMENTED, "Live source");
+        return FALSE;
+    }
+    gint64 duration{-1};
+    if (not gst_element_query_duration(thumbnailer.pipeline, GST_FORMAT_TIME, &duration)
+        or duration <= 0) {
+        g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "Unknown duration");
+        return FALSE;
+    }
+
+    Atlas atlas;
+    atlas.columns = MIN(count, guint(spriteColumns));
+    atlas.rows = (count + atlas.columns - 1) / atlas.columns;
+    for (guint i = 0; i < count; ++i) {
+        /* Middle of the i-th interval, the last frame is never at the very end */
+        const gint64 position = duration * (2 * i + 1) / (2 * count);
+        if (not gst_element_seek_simple(
+                thumbnailer.pipeline, GST_FORMAT_TIME, seekFlags(keyframesOnly), position)) {
+            g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "Not seekable");
+            return FALSE;
+        }
+        if (not waitAsyncDone(thumbnailer, error)) {
+            return FALSE;
+        }
+
+        GstSample* sample{};
+        g_signal_emit_by_name(thumbnailer.sink, "pull-preroll", &sample, NULL);
+        if (sample == nullptr) {
+            g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED, "No frame");
+            return FALSE;
+        }
+        const gboolean ok = compositeFrame(atlas, sample, i, error);
+        gst_sample_unref(sample);
+        if (not ok) {
+            return FALSE;
+        }
+    }
+
+    GstSample* sample = atlasSample(atlas);
+    const gboolean ok = writeImage(sample, path, error);
+    gst_sample_unref(sample);
+    return ok;
+}
+
+static const gchar*
+imageExtension()
+{
+    return imageFormat != nullptr ? imageFormat : "ppm";
+}
+
+/**
+ * Worker of batch mode. Frames are handed to the image writer thread and the pipeline
+ * goes on with the next file, results are printed once the thumbnail is written. The
+ * reported time is the snapshot time, encoding overlaps with the next file.
+ */
+static void
+thumbnailBatch(UriQueue& queue, std::atomic_uint& failed)
+{
+    Thumbnailer* thumbnailer = createThumbnailer();
+    ImageWriter writer;
+    for (guint index = queue.next++; index < queue.uris->len; index = queue.next++) {
+        const auto* uri = static_cast<const gchar*>(queue.uris->pdata[index]);
+        const gint64 begin = g_get_monotonic_time();
+
+        GError* error{};
+        SnapshotInfo info;
+        GstSample* sample = snapshot(*thumbnailer, uri, fast, &error, &info);
+        if (sample == nullptr) {
+            g_print("%s\tfailed\t%s\n", uri, error ? error->message : "unknown");
+            g_clear_error(&error);
+            failed++;
+            continue;
+        }
+        const gdouble elapsed
+            = (g_get_monotonic_time() - begin) / gdouble(G_TIME_SPAN_MILLISECOND);
+
+        gchar* name = g_strdup_printf("thumb-%06u.%s", index, imageExtension());
+        gchar* path = g_build_filename(outputDir ? outputDir : ".", name, NULL);
+        writer.write(sample, path, [uri, path = std::string{path}, elapsed, info, &failed](
+                                       const GError* error) {
+            if (error != nullptr) {
+                g_print("%s\tfailed\t%s\n", uri, error->message);
+                failed++;
+            } else if (info.latency >= 0) {
+                g_print("%s\t%s\t%.1f ms\tlive %.1f ms\n",
+                        uri,
+                        path.c_str(),
+                        elapsed,
+                        info.latency / gdouble(G_TIME_SPAN_MILLISECOND));
+            } else {
+                g_print(
+                    "%s\t%s\t%.1f ms\t%u reseeks\n", uri, path.c_str(), elapsed, info.reseeks);
+            }
+        });
+        gst_sample_unref(sample);
+        g_free(path);
+        g_free(name);
+    }
+    writer.finish();
+    destroyThumbnailer(thumbnailer);
+}
+
+static int
+runBatch(const gchar* listPath, const guint workers)
+{
+    UriQueue queue;
+    queue.uris = readUriList(listPath);
+    if (queue.uris == nullptr) {
+        return EXIT_FAILURE;
+    }
+    if (outputDir != nullptr and g_mkdir_with_parents(outputDir, 0755) != 0) {
+        g_printerr("Unable to create %s\n", outputDir);
+        g_ptr_array_unref(queue.uris);
+        return EXIT_FAILURE;
+    }
+
+    std::atomic_uint failed{};
+    std::vector<std::thread> threads;
+    const gint64 begin = g_get_monotonic_time();
+    for (guint i = 0; i < MIN(workers, queue.uris->len); ++i) {
+        threads.emplace_back(thumbnailBatch, std::ref(queue), std::ref(failed));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const gdouble seconds = (g_get_monotonic_time() - begin) / gdouble(G_USEC_PER_SEC);
+
+    g_printerr("%u thumbnails (%u failed) with %zu pipelines in %.3f s, %.1f files/s\n",
+               queue.uris->len - failed,
+               failed.load(),
+               threads.size(),
+               seconds,
+               queue.uris->len / seconds);
+    g_ptr_array_unref(queue.uris);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Process CPU time (us) of all threads, streaming threads included */
+static gint64
+cpuTime()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64{usage.ru_utime.tv_sec} + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/**
+ * Compare normal and keyframe only seek on one pipeline: time from the uri swap to the
+ * pulled sample and CPU time per thumbnail. Nothing else runs, so the process CPU time
+ * belongs to the thumbnail.
+ */
+static int
+runBench(const gchar* listPath)
+{
+    GPtrArray* uris = readUriList(listPath);
+    if (uris == nullptr) {
+        return EXIT_FAILURE;
+    }
+
+    Thumbnailer* thumbnailer = createThumbnailer();
+    g_print("%-8s %8s %8s %14s %14s %14s %8s %10s\n",
+            "mode",
+            "ok",
+            "failed",
+            "mean (ms)",
+            "max (ms)",
+            "cpu (ms)",
+            "reseeks",
+            "stats (us)");
+
+    /* The first pass warms up page cache and plugin loading, it is not reported */
+    for (const gint mode : {-1, 0, 1}) {
+        const gboolean keyframesOnly = (mode != 0);
+        guint ok{}, failed{};
+        gint64 wallTotal{}, wallMax{}, cpuTotal{};
+        SnapshotInfo info;
+        guint measured{};
+        for (guint i = 0; i < uris->len; ++i) {
+            GError* error{};
+            const gint64 wall0 = g_get_monotonic_time();
+            const gint64 cpu0 = cpuTime();
+            const guint reseeks = info.reseeks;
+            GstSample* sample = snapshot(*thumbnailer,
+                                         static_cast<const gchar*>(uris->pdata[i]),
+                                         keyframesOnly,
+                                         &error,
+                                         &info);
+            const gint64 wall = g_get_monotonic_time() - wall0;
+            const gint64 cpu = cpuTime() - cpu0;
+            if (sample == nullptr) {
+                failed++;
+                g_clear_error(&error);
+                continue;
+            }
+            gst_sample_unref(sample);
+            ok++;
+            /* Every pulled frame is measured once */
+            measured += 1 + info.reseeks - reseeks;
+            wallTotal += wall;
+            wallMax = MAX(wallMax, wall);
+            cpuTotal += cpu;
+        }
+        if (mode < 0) {
+            continue;
+        }
+        const gdouble count = MAX(ok, 1u);
+        g_print("%-8s %8u %8u %14.2f %14.2f %14.2f %8u %10.1f\n",
+                keyframesOnly ? "fast" : "normal",
+                ok,
+                failed,
+                wallTotal / count / G_TIME_SPAN_MILLISECOND,
+                wallMax / gdouble(G_TIME_SPAN_MILLISECOND),
+                cpuTotal / count / G_TIME_SPAN_MILLISECOND,
+                info.reseeks,
+                info.statsTime / gdouble(MAX(measured, 1u)));
+    }
+
+    destroyThumbnailer(thumbnailer);
+    g_ptr_array_unref(uris);
+    return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char* argv[])
+{
+    GOptionEntry options[] = {{"batch",
+                               'b',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &batchList,
+                               "Make thumbnail of every URI (or file path) listed in the file",
+                               nullptr},
+                              {"jobs",
+                               'j',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &jobs,
+                               "Number of pipelines in batch mode (0 - CPU count)",
+                               nullptr},
+                              {"output",
+                               'o',
+                               0,
+                               G_OPTION_ARG_FILENAME,
+                               &outputDir,
+                               "Directory of thumbnails in batch mode and of sprite sheet",
+                               nullptr},
+                              {"fast",
+                               'f',
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &fast,
+                               "Seek in key unit trick mode, only keyframes are decoded",
+                               nullptr},
+                              {"bench",
+                               0,
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &bench,
+                               "Compare time and CPU per thumbnail of normal and fast seek",
+                               nullptr},
+                              {"blank-step",
+                               0,
+                               0,
+                               G_OPTION_ARG_DOUBLE,
+                               &blankStep,
+                               "Seek step (seconds) past black or flat frame",
+                               nullptr},
+                              {"blank-retries",
+                               0,
+                               0,
+                               G_OPTION_ARG_INT,
+                               &blankRetries,
+                               "Seeks past black or flat frames (0 - keep the first frame)",
+                               nullptr},
+                              {"sprite",
+                               's',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &spriteFrames,
+                               "Write sprite sheet of N evenly spaced frames instead of snapshot",
+                               "N"},
+                              {"columns",
+                               0,
+                               0,
+                               G_OPTION_ARG_INT,
+                               &spriteColumns,
+                               "Frames per row of the sprite sheet",
+                               nullptr},
+                              {"format",
+                               0,
+                               0,
+                               G_OPTION_ARG_STRING,
+                               &imageFormat,
+                               "Image format: ppm (default), png or jpg",
+                               nullptr},
+                              {"timeout",
+                               't',
+                               0,
+                               G_OPTION_ARG_INT,
+                               &timeout,
+                               "Preroll (or live frame) timeout (seconds)",
+                               nullptr},
+                              {nullptr}};
+
+    GOptionContext* ctx = g_option_context_new("<uri>");
+    g_option_context_add_main_entries(ctx, options, nullptr);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    /* Initialize GStreamer */
+    GError* error{};
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("Error initializing: %s\n", error->message);
+        g_clear_error(&error);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(ctx);
+
+    if (timeout <= 0 or blankStep <= 0 or blankRetries < 0 or spriteFrames < 0
+        or spriteColumns <= 0
+        or (imageFormat != nullptr and not g_strv_contains(kImageFormats, imageFormat))) {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    if (batchList != nullptr and bench) {
+        return runBench(batchList);
+    }
+    if (batchList != nullptr) {
+        return runBatch(batchList, jobs > 0 ? jobs : g_get_num_processors());
+    }
+
+    if (argc != 2) {
+        g_print("usage: %s <uri>\n Writes snapshot in the current directory\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Thumbnailer* thumbnailer = createThumbnailer();
+    if (spriteFrames > 0) {
+        gchar* name = g_strdup_printf("sprite.%s", imageExtension());
+        gchar* path = g_build_filename(outputDir ? outputDir : ".", name, NULL);
+        const gint64 begin = g_get_monotonic_time();
+        const gboolean ok
+            = spriteSheet(*thumbnailer, argv[1], spriteFrames, fast, path, &error);
+        const gdouble elapsed
+            = (g_get_monotonic_time() - begin) / gdouble(G_TIME_SPAN_MILLISECOND);
+        if (ok) {
+            g_print("%s: %d frames in %.1f ms, %.2f ms per frame\n",
+                    path,
+                    spriteFrames,
+                    elapsed,
+                    elapsed / spriteFrames);
+        } else {
+            g_print("could not make sprite sheet: %s\n", error ? error->message : "unknown");
+            g_clear_error(&error);
+        }
+        g_free(path);
+        g_free(name);
+        destroyThumbnailer(thumbnailer);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    SnapshotInfo info;
+    GstSample* sample = snapshot(*thumbnailer, argv[1], fast, &error, &info);
+    gboolean ok{FALSE};
     if (sample) {
-        /**
-         * Get the snapshot buffer format now. We set the caps on the appsink so
-         * that it can only be an rgb buffer. The only thing we have not specified
-         * on the caps is the height, which is dependant on the pixel-aspect-ratio
-         * of the source material
-         */
-        GstCaps* caps = gst_sample_get_caps(sample);
-        if (!caps) {
-            g_print("could not get snapshot format\n");
-            return EXIT_FAILURE;
-        }
-        GstStructure* s = gst_caps_get_structure(caps, 0);
-
-        /* We need to get the final caps on the buffer to get the size */
-        gint width{}, height{};
-        gboolean res = gst_structure_get_int(s, "width", &width);
-        res |= gst_structure_get_int(s, "height", &height);
-        if (!res) {
-            g_print("could not get snapshot dimension\n");
-            return EXIT_FAILURE;
-        }
-
-        /**
-         * Create pixmap from buffer and save, gstreamer video buffers have a stride
-         * that is rounded up to the nearest multiple of 4
-         */
-        GstBuffer* buffer = gst_sample_get_buffer(sample);
-        /* Mapping a buffer can fail (non-readable) */
-        GstMapInfo map;
-        if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-#ifdef HAVE_GTK
-            pixbuf = gdk_pixbuf_new_from_data(map.data,
-                                              GDK_COLORSPACE_RGB,
-                                              FALSE,
-                                              8,
-                                              width,
-                                              height,
-                                              GST_ROUND_UP_4(width * 3),
-                                              NULL,
-                                              NULL);
-
-            /* Save the pixbuf */
-            gdk_pixbuf_save(pixbuf, "snapshot.png", "png", &error, NULL);
-#endif
-            gst_buffer_unmap(buffer, &map);
+        if (info.latency >= 0) {
+            g_print("Live frame %.1f ms after the request\n",
+                    info.latency / gdouble(G_TIME_SPAN_MILLISECOND));
         }
+        gchar* path = g_strdup_printf("snapshot.%s", imageExtension());
+        ok = writeImage(sample, path, &error);
         gst_sample_unref(sample);
-    } else {
-        g_print("could not make snapshot\n");
+        g_free(path);
+    }
+    if (not ok) {
+        g_print("could not make snapshot: %s\n", error ? error->message : "unknown");
+        g_clear_error(&error);
     }
 
     /* Cleanup and exit */
-    gst_element_set_state(pipeline, GST_STATE_NULL);
-    gst_object_unref(sink);
-    gst_object_unref(pipeline);
+    destroyThumbnailer(thumbnailer);
 
-    return EXIT_SUCCESS;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -14,66 +14,462 @@
 
 #include <gst/gst.h>
 
+/**
+ * Example 18: Switching effects of playing pipeline by blocking the queue src pad
+ *  + pre-warming: next effect is added and paused ahead, the block covers relinking only
+ *  + blocked time and frames dropped by the sink are reported per switch
+ *  + stateless effects are swapped under the block without EoS drain
+ *  + dual path: two effect slots behind "tee", "input-selector" flips to the slot rebuilt
+ *    in background, the main path is never blocked
+ *  + adaptive: effect cost and QoS drive fallback to a cheaper effect or lower resolution
+ */
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <utility>
+
 static gchar* selectedEffects{};
+static gboolean prewarm{};
+static gchar* selectedStateless{};
+static gboolean dual{};
+static gboolean adaptive{};
+static gchar* selectedFallbacks{};
+static gint width{320};
+static gint height{240};
 
 #define DEFAULT_EFFECTS                                                                            \
     "identity,exclusion,navigationtest,"                                                           \
     "agingtv,videoflip,vertigotv,gaussianblur,shagadelictv,edgetv"
 
+/* Effects keeping no frames between buffers, nothing to drain before removal */
+#define DEFAULT_STATELESS "identity,exclusion,navigationtest,videoflip,gaussianblur"
+
+/* Cheaper replacement of heavy effects, "<effect>=<fallback>" */
+#define DEFAULT_FALLBACKS "gaussianblur=videoflip,vertigotv=exclusion,agingtv=exclusion"
+
 static GstPad* blockpad{};
 static GstElement* convBefore{};
 static GstElement* convAfter{};
 static GstElement* curEffect{};
 static GstElement* pipeline{};
+static GstElement* videoSink{};
 
+/* Guards the queue and the effects moving between the streaming thread and the main loop */
+G_LOCK_DEFINE_STATIC(effects);
 static GQueue effects = G_QUEUE_INIT;
+/* Pre-warmed effect: in the pipeline, PAUSED and not linked */
+static GstElement* nextEffect{};
+/* Caps of the pre-warmed effect pads are negotiated, it is linked without checks */
+static gboolean nextNegotiated{};
+/* Effect removed by the last switch, set to NULL by the main loop */
+static GstElement* retiredEffect{};
+/* Effect requested by requestSwitch(), taken before the pre-warmed and queued ones */
+static GstElement* pendingTarget{};
+/* Switch is requested and not finished yet (main loop only) */
+static gboolean switchPending{};
+
+/* Details of a switch passed from the streaming thread to the main loop */
+struct SwitchReport {
+    gchar* from{};
+    gboolean drained{};
+    gint64 blocked{};
+};
+
+/* Switch latency by the factory of the removed effect */
+struct EffectLatency {
+    guint count{};
+    gint64 total{};
+    gint64 max{};
+    gboolean drained{};
+};
+
+static gchar** statelessNames{};
+static std::map<std::string, EffectLatency> latencies;
+
+/* Effect branch of the dual-path mode: "queue ! videoconvert ! effect ! videoconvert" */
+struct Slot {
+    GstElement* queue{};
+    GstElement* convBefore{};
+    GstElement* effect{};
+    GstElement* convAfter{};
+    GstPad* selectorPad{};
+    /* The effect has produced a frame since the rebuild */
+    gint ready{};
+    gint64 rebuildSince{};
+    gint64 rebuildTime{};
+    gint64 warmupTime{};
+};
+
+static Slot slots[2];
+static guint activeSlot{};
+static GstElement* selector{};
+static guint flips{};
+
+/* Longest interval between frames reaching the sink (us), stalls show up here */
+static std::atomic<gint64> lastFrame{};
+static std::atomic<gint64> frameGap{};
+static gint64 frameGapMax{};
+
+/* Controller of adaptive mode, the chain degrades one level at a time and restores back */
+enum class Degradation { None, Fallback, Resolution };
+
+struct Controller {
+    Degradation level{Degradation::None};
+    /* Factory of the effect replaced by the fallback */
+    gchar* original{};
+    /* QoS messages since the last tick */
+    guint qosEvents{};
+    gint64 maxJitter{};
+    /* Ticks to ignore after a change, the measurements are stale */
+    guint settleTicks{};
+    guint calmTicks{};
+    guint ticksSinceRestore{G_MAXUINT};
+    guint failedRestores{};
+};
+
+static constexpr guint kControlInterval{500}; /* ms */
+static constexpr gdouble kOverloadRatio{0.8};
+static constexpr gdouble kHeadroomRatio{0.4};
+static constexpr guint kCalmTicks{4};
+static constexpr guint kSettleTicks{2};
+
+static Controller controller;
+static GHashTable* fallbacks{};
+static GstElement* chainCaps{};
+static std::map<std::string, gint64> effectCosts;
+static gint64 frameInterval{};
+
+/* Per-frame cost of the current effect (us), moving average, 0 - unknown */
+static std::atomic<gint64> effectCost{};
+/* Streaming thread of q1 only */
+static gint64 frameEnter{};
+static GstElement* profiledEffect{};
+static gulong enterProbe{};
+static gulong leaveProbe{};
+
+/* Switch statistics */
+static guint switches{};
+static gint64 blockedTotal{};
+static gint64 blockedMax{};
+static guint64 droppedTotal{};
+static guint64 droppedBefore{};
+
+/* Frames dropped by the sink so far (late ones, e.g. after a stall of the stream) */
+static guint64
+droppedFrames()
+{
+    GstStructure* stats{};
+    g_object_get(videoSink, "stats", &stats, NULL);
+    guint64 dropped{};
+    if (stats != nullptr) {
+        gst_structure_get_uint64(stats, "dropped", &dropped);
+        gst_structure_free(stats);
+    }
+    return dropped;
+}
 
-/* Called then EoS event leaves SRC pad of current effect element */
 static GstPadProbeReturn
-onProbeEvent(GstPad* pad, GstPadProbeInfo* info, gpointer data)
+onSinkBuffer(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer /*data*/)
 {
-    auto* loop = static_cast<GMainLoop*>(data);
-    g_assert(loop != nullptr);
+    const gint64 now = g_get_monotonic_time();
+    const gint64 last = lastFrame.exchange(now);
+    if (last != 0 and now - last > frameGap.load()) {
+        frameGap.store(now - last);
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_DATA(info)) != GST_EVENT_EOS) {
-        return GST_PAD_PROBE_OK;
+/* Print frames dropped by the sink and the longest frame gap since the previous call */
+static void
+reportFrames()
+{
+    const guint64 dropped = droppedFrames();
+    const gint64 gap = frameGap.exchange(0);
+    if (switches + flips > 0) {
+        g_print("Dropped %" G_GUINT64_FORMAT " frames, max frame gap %.1f ms since the switch\n",
+                dropped - droppedBefore,
+                gap / gdouble(G_TIME_SPAN_MILLISECOND));
+        droppedTotal += dropped - droppedBefore;
+        frameGapMax = MAX(frameGapMax, gap);
     }
+    droppedBefore = dropped;
+}
 
-    /* Removed event probe */
-    gst_pad_remove_probe(pad, GST_PAD_PROBE_INFO_ID(info));
+/* Push sticky event of the upstream pad into the pad, returns FALSE if it was refused */
+static gboolean
+forwardSticky(GstPad* upstream, GstPad* pad, const GstEventType type)
+{
+    GstEvent* event = gst_pad_get_sticky_event(upstream, type, 0);
+    return event != nullptr and gst_pad_send_event(pad, event);
+}
 
-    /* Take next effect from the queue */
-    auto* next = static_cast<GstElement*>(g_queue_pop_head(&effects));
+/**
+ * Add the effect to the pipeline and bring it to PAUSED, so its resources are allocated
+ * outside of the blocked window. The caps currently flowing into the effect position are
+ * sent to the effect ahead, so the switch doesn't renegotiate. Returns TRUE if the
+ * effect has been configured with them and its output is accepted by "convAfter".
+ */
+static gboolean
+prepareEffect(GstElement* effect)
+{
+    gst_bin_add(GST_BIN(pipeline), effect);
+    gst_element_set_state(effect, GST_STATE_PAUSED);
+
+    GstPad* upstream = gst_element_get_static_pad(convBefore, "src");
+    GstPad* sinkPad = gst_element_get_static_pad(effect, "sink");
+    GstPad* srcPad = gst_element_get_static_pad(effect, "src");
+    GstPad* downstream = gst_element_get_static_pad(convAfter, "sink");
+
+    /* Stream start goes first, caps event is refused otherwise */
+    gboolean negotiated = forwardSticky(upstream, sinkPad, GST_EVENT_STREAM_START)
+                          and forwardSticky(upstream, sinkPad, GST_EVENT_CAPS);
+    if (negotiated) {
+        /* The effect has pushed its output caps to the unlinked source pad */
+        GstCaps* caps = gst_pad_get_current_caps(srcPad);
+        negotiated = caps != nullptr and gst_pad_query_accept_caps(downstream, caps);
+        if (caps != nullptr) {
+            gst_caps_unref(caps);
+        }
+    }
+    g_print("Prepared '%s'%s\n",
+            GST_OBJECT_NAME(effect),
+            negotiated ? ", caps are negotiated" : ", caps are negotiated on switch");
+
+    gst_object_unref(downstream);
+    gst_object_unref(srcPad);
+    gst_object_unref(sinkPad);
+    gst_object_unref(upstream);
+    return negotiated;
+}
+
+/* Link the pre-warmed effect, caps of its pads have been negotiated ahead */
+static void
+linkPrepared(GstElement* effect)
+{
+    GstPad* upstream = gst_element_get_static_pad(convBefore, "src");
+    GstPad* sinkPad = gst_element_get_static_pad(effect, "sink");
+    GstPad* srcPad = gst_element_get_static_pad(effect, "src");
+    GstPad* downstream = gst_element_get_static_pad(convAfter, "sink");
+    gst_pad_link_full(upstream, sinkPad, GST_PAD_LINK_CHECK_NOTHING);
+    gst_pad_link_full(srcPad, downstream, GST_PAD_LINK_CHECK_NOTHING);
+    gst_object_unref(downstream);
+    gst_object_unref(srcPad);
+    gst_object_unref(sinkPad);
+    gst_object_unref(upstream);
+}
+
+static GstPadProbeReturn
+onEffectEnter(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer /*data*/)
+{
+    frameEnter = g_get_monotonic_time();
+    return GST_PAD_PROBE_OK;
+}
+
+/* Effects don't have own threads, the frame leaves the effect in the thread it entered */
+static GstPadProbeReturn
+onEffectLeave(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer /*data*/)
+{
+    if (frameEnter != 0) {
+        const gint64 cost = g_get_monotonic_time() - frameEnter;
+        const gint64 average = effectCost.load();
+        effectCost.store(average == 0 ? cost : average + (cost - average) / 8);
+        frameEnter = 0;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Move the cost probes to the effect, data must not flow (blocked or not started) */
+static void
+profileEffect(GstElement* effect)
+{
+    if (profiledEffect != nullptr) {
+        GstPad* sinkPad = gst_element_get_static_pad(profiledEffect, "sink");
+        GstPad* srcPad = gst_element_get_static_pad(profiledEffect, "src");
+        gst_pad_remove_probe(sinkPad, enterProbe);
+        gst_pad_remove_probe(srcPad, leaveProbe);
+        gst_object_unref(srcPad);
+        gst_object_unref(sinkPad);
+    }
+
+    GstPad* sinkPad = gst_element_get_static_pad(effect, "sink");
+    GstPad* srcPad = gst_element_get_static_pad(effect, "src");
+    enterProbe
+        = gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, onEffectEnter, nullptr, nullptr);
+    leaveProbe
+        = gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BUFFER, onEffectLeave, nullptr, nullptr);
+    gst_object_unref(srcPad);
+    gst_object_unref(sinkPad);
+
+    profiledEffect = effect;
+    frameEnter = 0;
+    effectCost.store(0);
+}
+
+static const gchar*
+factoryName(GstElement* element)
+{
+    return GST_OBJECT_NAME(gst_element_get_factory(element));
+}
+
+static gboolean
+isStateless(GstElement* effect)
+{
+    return statelessNames != nullptr and g_strv_contains(statelessNames, factoryName(effect));
+}
+
+/* Finish the switch in the main loop: release the removed effect and prepare the next one */
+static gboolean
+onSwitched(gpointer data)
+{
+    auto* report = static_cast<SwitchReport*>(data);
+    const gint64 blocked = report->blocked;
+    switchPending = FALSE;
+    switches++;
+    blockedTotal += blocked;
+    blockedMax = MAX(blockedMax, blocked);
+    EffectLatency& latency = latencies[report->from];
+    latency.count++;
+    latency.total += blocked;
+    latency.max = MAX(latency.max, blocked);
+    latency.drained = report->drained;
+    g_print("Switched from '%s' to '%s' (%s), blocked %.2f ms\n",
+            report->from,
+            GST_OBJECT_NAME(curEffect),
+            report->drained ? "drained" : "fast",
+            blocked / gdouble(G_TIME_SPAN_MILLISECOND));
+    g_free(report->from);
+    delete report;
+
+    G_LOCK(effects);
+    GstElement* retired = g_steal_pointer(&retiredEffect);
+    G_UNLOCK(effects);
+    if (retired != nullptr) {
+        gst_element_set_state(retired, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), retired);
+    }
+
+    G_LOCK(effects);
+    if (retired != nullptr) {
+        g_queue_push_tail(&effects, retired);
+    }
+    GstElement* next{};
+    if (prewarm and nextEffect == nullptr) {
+        next = static_cast<GstElement*>(g_queue_pop_head(&effects));
+    }
+    G_UNLOCK(effects);
+
+    if (next != nullptr) {
+        const gboolean negotiated = prepareEffect(next);
+        G_LOCK(effects);
+        nextEffect = next;
+        nextNegotiated = negotiated;
+        G_UNLOCK(effects);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Replace the current effect by the pre-warmed or the next queued one, the data flow
+ * into the effect must be stopped. Returns FALSE if there is no effect to switch to.
+ */
+static gboolean
+switchEffect()
+{
+    /* Take requested, pre-warmed or the next effect from the queue */
+    G_LOCK(effects);
+    auto* next = static_cast<GstElement*>(g_steal_pointer(&pendingTarget));
+    gboolean prepared{};
+    gboolean negotiated{};
     if (next == nullptr) {
-        GST_DEBUG_OBJECT(pad, "no more effects");
-        g_main_loop_quit(loop);
-        return GST_PAD_PROBE_DROP;
+        next = static_cast<GstElement*>(g_steal_pointer(&nextEffect));
+        prepared = (next != nullptr);
+        negotiated = prepared and nextNegotiated;
+    }
+    if (next == nullptr) {
+        next = static_cast<GstElement*>(g_queue_pop_head(&effects));
     }
+    G_UNLOCK(effects);
+    if (next == nullptr) {
+        GST_DEBUG_OBJECT(pipeline, "no more effects");
+        return FALSE;
+    }
+
+    GST_DEBUG_OBJECT(
+        pipeline, "switching from '%s' to '%s'", GST_OBJECT_NAME(curEffect), GST_OBJECT_NAME(next));
 
-    g_print("Switching from '%s' to '%s'..\n", GST_OBJECT_NAME(curEffect), GST_OBJECT_NAME(next));
+    if (prepared) {
+        /* Unlink only, the removed effect is released by the main loop */
+        GstPad* sinkPad = gst_element_get_static_pad(curEffect, "sink");
+        GstPad* srcPad = gst_element_get_static_pad(curEffect, "src");
+        GstPad* upstream = gst_pad_get_peer(sinkPad);
+        GstPad* downstream = gst_pad_get_peer(srcPad);
+        gst_pad_unlink(upstream, sinkPad);
+        gst_pad_unlink(srcPad, downstream);
+        gst_object_unref(downstream);
+        gst_object_unref(upstream);
+        gst_object_unref(srcPad);
+        gst_object_unref(sinkPad);
+
+        if (negotiated) {
+            linkPrepared(next);
+        } else {
+            /* Caps were unknown or refused ahead, the link checks them */
+            gst_element_link_many(convBefore, next, convAfter, NULL);
+        }
+        gst_element_set_state(next, GST_STATE_PLAYING);
 
-    /* Nullify current element */
-    gst_element_set_state(curEffect, GST_STATE_NULL);
+        G_LOCK(effects);
+        retiredEffect = g_steal_pointer(&curEffect);
+        G_UNLOCK(effects);
+    } else {
+        /* Nullify current element */
+        gst_element_set_state(curEffect, GST_STATE_NULL);
 
-    /* Remove unlinks automatically */
-    GST_DEBUG_OBJECT(pipeline, "removing %" GST_PTR_FORMAT, curEffect);
-    gst_bin_remove(GST_BIN(pipeline), curEffect);
+        /* Remove unlinks automatically */
+        GST_DEBUG_OBJECT(pipeline, "removing %" GST_PTR_FORMAT, curEffect);
+        gst_bin_remove(GST_BIN(pipeline), curEffect);
 
-    /* Push current effect back into the queue */
-    g_queue_push_tail(&effects, g_steal_pointer(&curEffect));
+        /* Push current effect back into the queue */
+        G_LOCK(effects);
+        g_queue_push_tail(&effects, g_steal_pointer(&curEffect));
+        G_UNLOCK(effects);
 
-    /* Add and link new effect */
-    GST_DEBUG_OBJECT(pipeline, "adding %" GST_PTR_FORMAT, next);
-    gst_bin_add(GST_BIN(pipeline), next);
-    GST_DEBUG_OBJECT(pipeline, "linking...");
-    gst_element_link_many(convBefore, next, convAfter, NULL);
+        /* Add and link new effect */
+        GST_DEBUG_OBJECT(pipeline, "adding %" GST_PTR_FORMAT, next);
+        gst_bin_add(GST_BIN(pipeline), next);
+        GST_DEBUG_OBJECT(pipeline, "linking...");
+        gst_element_link_many(convBefore, next, convAfter, NULL);
 
-    /* Start new effect */
-    gst_element_set_state(next, GST_STATE_PLAYING);
+        /* Start new effect */
+        gst_element_set_state(next, GST_STATE_PLAYING);
+    }
 
     curEffect = next;
+    if (adaptive) {
+        profileEffect(next);
+    }
     GST_DEBUG_OBJECT(pipeline, "done");
+    return TRUE;
+}
 
+/* Called then EoS event leaves SRC pad of current effect element */
+static GstPadProbeReturn
+onProbeEvent(GstPad* pad, GstPadProbeInfo* info, gpointer data)
+{
+    auto* loop = static_cast<GMainLoop*>(data);
+    g_assert(loop != nullptr);
+
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_DATA(info)) != GST_EVENT_EOS) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* Removed event probe */
+    gst_pad_remove_probe(pad, GST_PAD_PROBE_INFO_ID(info));
+
+    if (not switchEffect()) {
+        g_main_loop_quit(loop);
+    }
     return GST_PAD_PROBE_DROP;
 }
 
@@ -82,11 +478,30 @@ static GstPadProbeReturn
 onPadProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data)
 {
     GST_DEBUG_OBJECT(pad, "Pad is blocked now");
+    const gint64 blockedSince = g_get_monotonic_time();
 
     /* Remove the probe first */
     gst_pad_remove_probe(pad, GST_PAD_PROBE_INFO_ID(info));
 
+    auto* report = new SwitchReport;
+    report->from = g_strdup(factoryName(curEffect));
+    report->drained = not isStateless(curEffect);
+
+    /* Nothing is kept inside, the data flow is stopped here and the effect is swapped */
+    if (not report->drained) {
+        if (switchEffect()) {
+            report->blocked = g_get_monotonic_time() - blockedSince;
+            g_idle_add(onSwitched, report);
+        } else {
+            g_free(report->from);
+            delete report;
+            g_main_loop_quit(static_cast<GMainLoop*>(data));
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
     /* Install new probe for EoS (we need to flush removing element internal data) */
+    GstElement* drained = curEffect;
     GstPad* srcPad = gst_element_get_static_pad(curEffect, "src");
     gst_pad_add_probe(
         srcPad,
@@ -104,18 +519,329 @@ onPadProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data)
     gst_pad_send_event(sinkPad, gst_event_new_eos());
     gst_object_unref(sinkPad);
 
+    /**
+     * Effects don't have own threads, EoS is drained and the effect switched in this call.
+     * The queue streaming thread was held for all this time.
+     */
+    if (curEffect == drained) {
+        /* No effect to switch to, the loop is quitting */
+        g_free(report->from);
+        delete report;
+        return GST_PAD_PROBE_OK;
+    }
+    report->blocked = g_get_monotonic_time() - blockedSince;
+    g_idle_add(onSwitched, report);
+
     return GST_PAD_PROBE_OK;
 }
 
+/**
+ * Switch to the target effect (owned by the call) or to the next one if nullptr. The
+ * switch goes through the block of q1 and the drain of the current effect if needed.
+ */
+static void
+requestSwitch(GstElement* target, gpointer loop)
+{
+    if (target != nullptr) {
+        G_LOCK(effects);
+        pendingTarget = target;
+        G_UNLOCK(effects);
+    }
+    switchPending = TRUE;
+
+    /* Block SRC pad on queue (q1) */
+    gst_pad_add_probe(blockpad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, onPadProbe, loop, NULL);
+}
+
 /* Called after 1 second timeout */
 static gboolean
 onTimeout(gpointer data)
 {
-    /* Block SRC pad on queue (q1) */
-    gst_pad_add_probe(blockpad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, onPadProbe, data, NULL);
+    /* Late frames of the previous switch are dropped by the sink by now */
+    reportFrames();
+
+    if (not switchPending) {
+        requestSwitch(nullptr, data);
+    }
     return TRUE;
 }
 
+/* Take the effect of the factory out of the queue, a new one is made if not queued */
+static GstElement*
+takeEffect(const gchar* name)
+{
+    G_LOCK(effects);
+    GList* link = g_queue_find_custom(
+        &effects, name, [](gconstpointer effect, gconstpointer factory) -> gint {
+            return g_strcmp0(factoryName(GST_ELEMENT(effect)), static_cast<const gchar*>(factory));
+        });
+    GstElement* effect{};
+    if (link != nullptr) {
+        effect = GST_ELEMENT(link->data);
+        g_queue_delete_link(&effects, link);
+    }
+    G_UNLOCK(effects);
+
+    if (effect == nullptr) {
+        if (effect = gst_element_factory_make(name, nullptr); effect) {
+            gst_object_ref_sink(effect);
+        }
+    }
+    return effect;
+}
+
+/* Frame interval of the chain (us) */
+static gint64
+frameBudget()
+{
+    gint num{30}, den{1};
+    GstPad* srcPad = gst_element_get_static_pad(convBefore, "src");
+    if (GstCaps* caps = gst_pad_get_current_caps(srcPad); caps) {
+        const GstStructure* s = gst_caps_get_structure(caps, 0);
+        if (not gst_structure_get_fraction(s, "framerate", &num, &den) or num <= 0) {
+            num = 30;
+            den = 1;
+        }
+        gst_caps_unref(caps);
+    }
+    gst_object_unref(srcPad);
+    return gint64{G_USEC_PER_SEC} * den / num;
+}
+
+/* Resolution of the chain between q1 and the effect, full or halved */
+static void
+setChainResolution(const gboolean reduced)
+{
+    GstCaps* caps = gst_caps_new_simple("video/x-raw",
+                                        "width",
+                                        G_TYPE_INT,
+                                        reduced ? width / 2 : width,
+                                        "height",
+                                        G_TYPE_INT,
+                                        reduced ? height / 2 : height,
+                                        NULL);
+    g_object_set(chainCaps, "caps", caps, NULL);
+    gst_caps_unref(caps);
+}
+
+/* Step down: a fallback effect first (if configured), lower resolution then */
+static void
+degrade(gpointer loop)
+{
+    const gchar* current = factoryName(curEffect);
+    const auto* fallback = static_cast<const gchar*>(
+        controller.level == Degradation::None ? g_hash_table_lookup(fallbacks, current)
+                                              : nullptr);
+    if (GstElement* effect = fallback ? takeEffect(fallback) : nullptr; effect) {
+        g_print("Falling behind, '%s' is replaced by '%s'\n", current, fallback);
+        controller.original = g_strdup(current);
+        controller.level = Degradation::Fallback;
+        requestSwitch(effect, loop);
+    } else if (controller.level != Degradation::Resolution) {
+        g_print("Falling behind, resolution is lowered to %dx%d\n", width / 2, height / 2);
+        controller.level = Degradation::Resolution;
+        setChainResolution(TRUE);
+        effectCost.store(0);
+    } else {
+        return;
+    }
+    controller.settleTicks = kSettleTicks;
+
+    /* Restored too early, wait longer next time */
+    if (controller.ticksSinceRestore < kCalmTicks * 2) {
+        controller.failedRestores++;
+    }
+}
+
+/* Step back up in the reverse order */
+static void
+restore(gpointer loop)
+{
+    if (controller.level == Degradation::Resolution) {
+        g_print("Headroom, resolution is restored to %dx%d\n", width, height);
+        setChainResolution(FALSE);
+        effectCost.store(0);
+        controller.level
+            = controller.original != nullptr ? Degradation::Fallback : Degradation::None;
+    } else if (controller.level == Degradation::Fallback) {
+        GstElement* effect = takeEffect(controller.original);
+        if (effect == nullptr) {
+            return;
+        }
+        g_print("Headroom, '%s' is restored\n", controller.original);
+        g_clear_pointer(&controller.original, g_free);
+        controller.level = Degradation::None;
+        requestSwitch(effect, loop);
+    } else {
+        return;
+    }
+    controller.settleTicks = kSettleTicks;
+    controller.ticksSinceRestore = 0;
+}
+
+/**
+ * Chain falls behind if the sink or effects report QoS (late frames) or the effect takes
+ * most of the frame interval. Headroom needs a low cost for a few ticks in a row, the
+ * number grows with each restore which had to be undone.
+ */
+static gboolean
+onControlTick(gpointer data)
+{
+    const guint qos = std::exchange(controller.qosEvents, 0);
+    const gint64 jitter = std::exchange(controller.maxJitter, 0);
+    if (controller.ticksSinceRestore != G_MAXUINT) {
+        controller.ticksSinceRestore++;
+    }
+    if (switchPending) {
+        return TRUE;
+    }
+    if (controller.settleTicks > 0) {
+        controller.settleTicks--;
+        return TRUE;
+    }
+
+    const gint64 cost = effectCost.load();
+    const gint64 budget = frameBudget();
+    frameInterval = budget;
+    if (cost > 0) {
+        effectCosts[factoryName(curEffect)] = cost;
+    }
+
+    if (qos > 0 or cost > budget * kOverloadRatio) {
+        GST_DEBUG("behind: cost %" G_GINT64_FORMAT " us of %" G_GINT64_FORMAT
+                  " us, %u QoS, jitter %" G_GINT64_FORMAT " us",
+                  cost,
+                  budget,
+                  qos,
+                  jitter);
+        controller.calmTicks = 0;
+        degrade(data);
+    } else if (cost > 0 and cost < budget * kHeadroomRatio) {
+        if (++controller.calmTicks >= kCalmTicks << MIN(controller.failedRestores, 4u)) {
+            controller.calmTicks = 0;
+            restore(data);
+        }
+    } else {
+        controller.calmTicks = 0;
+    }
+    return TRUE;
+}
+
+/* First frame out of the rebuilt slot effect, the slot can be made active */
+static GstPadProbeReturn
+onSlotBuffer(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer data)
+{
+    auto* slot = static_cast<Slot*>(data);
+    slot->warmupTime = g_get_monotonic_time() - slot->rebuildSince;
+    g_atomic_int_set(&slot->ready, TRUE);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+watchSlot(Slot& slot)
+{
+    GstPad* srcPad = gst_element_get_static_pad(slot.effect, "src");
+    gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BUFFER, onSlotBuffer, &slot, nullptr);
+    gst_object_unref(srcPad);
+}
+
+/**
+ * Inactive slot queue is blocked, its output is discarded by the selector anyway, so the
+ * effect is replaced without EoS drain. Only the slot streaming thread waits here.
+ */
+static GstPadProbeReturn
+onSlotBlocked(GstPad* /*pad*/, GstPadProbeInfo* /*info*/, gpointer data)
+{
+    auto* slot = static_cast<Slot*>(data);
+    const gint64 begin = g_get_monotonic_time();
+
+    G_LOCK(effects);
+    auto* next = static_cast<GstElement*>(g_queue_pop_head(&effects));
+    G_UNLOCK(effects);
+    if (next != nullptr) {
+        gst_element_set_state(slot->effect, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), slot->effect);
+        G_LOCK(effects);
+        g_queue_push_tail(&effects, g_steal_pointer(&slot->effect));
+        G_UNLOCK(effects);
+
+        gst_bin_add(GST_BIN(pipeline), next);
+        gst_element_link_many(slot->convBefore, next, slot->convAfter, NULL);
+        gst_element_sync_state_with_parent(next);
+        slot->effect = next;
+    }
+    slot->rebuildTime = g_get_monotonic_time() - begin;
+    watchSlot(*slot);
+
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+rebuildSlot(Slot& slot)
+{
+    g_atomic_int_set(&slot.ready, FALSE);
+    slot.rebuildSince = g_get_monotonic_time();
+    GstPad* srcPad = gst_element_get_static_pad(slot.queue, "src");
+    gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, onSlotBlocked, &slot, nullptr);
+    gst_object_unref(srcPad);
+}
+
+/* Called after 1 second timeout in dual-path mode */
+static gboolean
+onFlipTimeout(gpointer /*data*/)
+{
+    reportFrames();
+
+    /* The effect of the slot may be replaced by its streaming thread until it is ready */
+    Slot& next = slots[activeSlot ^ 1];
+    if (not g_atomic_int_get(&next.ready)) {
+        g_print("Inactive slot is not ready yet, flip postponed\n");
+        return TRUE;
+    }
+
+    /* Selector switches on the next buffer of the pad, nothing upstream is held */
+    g_object_set(selector, "active-pad", next.selectorPad, NULL);
+    activeSlot ^= 1;
+    flips++;
+    g_print("Flipped to '%s', rebuilt in %.2f ms and warmed up in %.2f ms in background\n",
+            GST_OBJECT_NAME(next.effect),
+            next.rebuildTime / gdouble(G_TIME_SPAN_MILLISECOND),
+            next.warmupTime / gdouble(G_TIME_SPAN_MILLISECOND));
+
+    /* Slot gone inactive gets the next effect of the queue */
+    rebuildSlot(slots[activeSlot ^ 1]);
+    return TRUE;
+}
+
+/* Build the slot between the tee and the selector */
+static void
+createSlot(Slot& slot, GstElement* tee, GstElement* effect)
+{
+    slot.queue = gst_element_factory_make("queue", nullptr);
+    g_assert(slot.queue != nullptr);
+    slot.convBefore = gst_element_factory_make("videoconvert", nullptr);
+    g_assert(slot.convBefore != nullptr);
+    slot.convAfter = gst_element_factory_make("videoconvert", nullptr);
+    g_assert(slot.convAfter != nullptr);
+    slot.effect = effect;
+
+    /* Blocked inactive slot must not hold the tee, its old frames are dropped instead */
+    gst_util_set_object_arg(G_OBJECT(slot.queue), "leaky", "downstream");
+    g_object_set(slot.queue, "max-size-buffers", 2, NULL);
+
+    gst_bin_add_many(
+        GST_BIN(pipeline), slot.queue, slot.convBefore, effect, slot.convAfter, nullptr);
+    gst_element_link_many(tee, slot.queue, slot.convBefore, effect, slot.convAfter, nullptr);
+
+    slot.selectorPad = gst_element_request_pad_simple(selector, "sink_%u");
+    GstPad* srcPad = gst_element_get_static_pad(slot.convAfter, "src");
+    gst_pad_link(srcPad, slot.selectorPad);
+    gst_object_unref(srcPad);
+
+    slot.rebuildSince = g_get_monotonic_time();
+    watchSlot(slot);
+}
+
 static gboolean
 onBusMessage(GstBus* /*bus*/, GstMessage* msg, gpointer data)
 {
@@ -123,6 +849,13 @@ onBusMessage(GstBus* /*bus*/, GstMessage* msg, gpointer data)
     g_assert(loop != nullptr);
 
     switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_QOS: {
+        gint64 jitter{};
+        gst_message_parse_qos_values(msg, &jitter, nullptr, nullptr);
+        controller.qosEvents++;
+        controller.maxJitter = MAX(controller.maxJitter, jitter);
+        break;
+    }
     case GST_MESSAGE_ERROR: {
         GError* err{};
         gchar* dbg;
@@ -149,6 +882,57 @@ main(int argc, char** argv)
                                &selectedEffects,
                                "Effects to use (comma-separated list of element names)",
                                nullptr},
+                              {"prewarm",
+                               'p',
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &prewarm,
+                               "Prepare the next effect ahead of the switch",
+                               nullptr},
+                              {"stateless",
+                               's',
+                               0,
+                               G_OPTION_ARG_STRING,
+                               &selectedStateless,
+                               "Effects swapped without EoS drain (comma-separated list of "
+                               "element names, empty - drain all)",
+                               nullptr},
+                              {"dual",
+                               'd',
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &dual,
+                               "Switch between two effect slots with input-selector",
+                               nullptr},
+                              {"adaptive",
+                               'a',
+                               0,
+                               G_OPTION_ARG_NONE,
+                               &adaptive,
+                               "Keep the effect, degrade it when the chain falls behind",
+                               nullptr},
+                              {"fallbacks",
+                               'f',
+                               0,
+                               G_OPTION_ARG_STRING,
+                               &selectedFallbacks,
+                               "Cheaper effects of adaptive mode (comma-separated list of "
+                               "<effect>=<fallback>)",
+                               nullptr},
+                              {"width",
+                               0,
+                               0,
+                               G_OPTION_ARG_INT,
+                               &width,
+                               "Frame width (320 by default)",
+                               nullptr},
+                              {"height",
+                               0,
+                               0,
+                               G_OPTION_ARG_INT,
+                               &height,
+                               "Frame height (240 by default)",
+                               nullptr},
                               {nullptr}};
 
     GOptionContext* ctx = g_option_context_new("");
@@ -169,6 +953,31 @@ main(int argc, char** argv)
         effectNames = g_strsplit(DEFAULT_EFFECTS, ",", -1);
     }
 
+    statelessNames = g_strsplit(selectedStateless ? selectedStateless : DEFAULT_STATELESS, ",", -1);
+
+    if (adaptive and dual) {
+        g_printerr("Adaptive mode needs the single path\n");
+        return EXIT_FAILURE;
+    }
+    if (width < 2 or height < 2) {
+        g_printerr("Invalid frame size %dx%d\n", width, height);
+        return EXIT_FAILURE;
+    }
+    /* Effect of adaptive mode changes on demand only */
+    prewarm = prewarm and not adaptive;
+
+    fallbacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    gchar** fallbackPairs
+        = g_strsplit(selectedFallbacks ? selectedFallbacks : DEFAULT_FALLBACKS, ",", -1);
+    for (gchar** pair = fallbackPairs; *pair != nullptr; ++pair) {
+        gchar** names = g_strsplit(*pair, "=", 2);
+        if (g_strv_length(names) == 2) {
+            g_hash_table_insert(fallbacks, g_strdup(names[0]), g_strdup(names[1]));
+        }
+        g_strfreev(names);
+    }
+    g_strfreev(fallbackPairs);
+
     gchar** e{};
     for (e = effectNames; e != nullptr && *e != nullptr; ++e) {
         if (GstElement* el = gst_element_factory_make(*e, nullptr); el) {
@@ -184,52 +993,161 @@ main(int argc, char** argv)
     g_object_set(src, "is-live", TRUE, NULL);
     GstElement* filter = gst_element_factory_make("capsfilter", nullptr);
     g_assert(filter != nullptr);
-    gst_util_set_object_arg(G_OBJECT(filter),
-                            "caps",
-                            "video/x-raw, width=320, height=240, "
-                            "format={ I420, YV12, YUY2, UYVY, AYUV, Y41B, Y42B, "
-                            "YVYU, Y444, v210, v216, NV12, NV21, UYVP, A420, YUV9, YVU9, IYU1 }");
-
-    GstElement* q1 = gst_element_factory_make("queue", nullptr);
-    g_assert(q1 != nullptr);
-    blockpad = gst_element_get_static_pad(q1, "src");
-    convBefore = gst_element_factory_make("videoconvert", nullptr);
-    g_assert(q1 != nullptr);
-    convAfter = gst_element_factory_make("videoconvert", nullptr);
-    g_assert(q1 != nullptr);
+    gchar* caps = g_strdup_printf(
+        "video/x-raw, width=%d, height=%d, "
+        "format={ I420, YV12, YUY2, UYVY, AYUV, Y41B, Y42B, "
+        "YVYU, Y444, v210, v216, NV12, NV21, UYVP, A420, YUV9, YVU9, IYU1 }",
+        width,
+        height);
+    gst_util_set_object_arg(G_OBJECT(filter), "caps", caps);
+    g_free(caps);
+
     GstElement* q2 = gst_element_factory_make("queue", nullptr);
-    g_assert(q1 != nullptr);
+    g_assert(q2 != nullptr);
     GstElement* sink = gst_element_factory_make("ximagesink", nullptr);
-    g_assert(q1 != nullptr);
+    g_assert(sink != nullptr);
+    videoSink = sink;
 
-    auto* effect = static_cast<GstElement*>(g_queue_pop_head(&effects));
-    curEffect = effect;
+    GstPad* sinkPad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, onSinkBuffer, nullptr, nullptr);
+    gst_object_unref(sinkPad);
 
-    gst_bin_add_many(
-        GST_BIN(pipeline), src, filter, q1, convBefore, effect, convAfter, q2, sink, nullptr);
-    gst_element_link_many(src, filter, q1, convBefore, effect, convAfter, q2, sink, nullptr);
+    if (dual) {
+        if (g_queue_get_length(&effects) < 2) {
+            g_printerr("Dual path needs two effects at least\n");
+            return EXIT_FAILURE;
+        }
+        GstElement* tee = gst_element_factory_make("tee", nullptr);
+        g_assert(tee != nullptr);
+        selector = gst_element_factory_make("input-selector", nullptr);
+        g_assert(selector != nullptr);
+        /* Frames of the inactive slot are dropped at once, not synchronized */
+        g_object_set(selector, "sync-streams", FALSE, NULL);
+
+        gst_bin_add_many(GST_BIN(pipeline), src, filter, tee, selector, q2, sink, nullptr);
+        gst_element_link_many(src, filter, tee, nullptr);
+        for (Slot& slot : slots) {
+            createSlot(slot, tee, static_cast<GstElement*>(g_queue_pop_head(&effects)));
+        }
+        gst_element_link_many(selector, q2, sink, nullptr);
+        g_object_set(selector, "active-pad", slots[activeSlot].selectorPad, NULL);
+    } else {
+        GstElement* q1 = gst_element_factory_make("queue", nullptr);
+        g_assert(q1 != nullptr);
+        blockpad = gst_element_get_static_pad(q1, "src");
+        convBefore = gst_element_factory_make("videoconvert", nullptr);
+        g_assert(convBefore != nullptr);
+        convAfter = gst_element_factory_make("videoconvert", nullptr);
+        g_assert(convAfter != nullptr);
+
+        auto* effect = static_cast<GstElement*>(g_queue_pop_head(&effects));
+        curEffect = effect;
+
+        gst_bin_add_many(
+            GST_BIN(pipeline), src, filter, q1, convBefore, effect, convAfter, q2, sink, nullptr);
+        if (adaptive) {
+            /* Chain resolution is lowered before the effect and scaled back after it */
+            GstElement* scaleDown = gst_element_factory_make("videoscale", nullptr);
+            g_assert(scaleDown != nullptr);
+            chainCaps = gst_element_factory_make("capsfilter", nullptr);
+            g_assert(chainCaps != nullptr);
+            GstElement* scaleUp = gst_element_factory_make("videoscale", nullptr);
+            g_assert(scaleUp != nullptr);
+            GstElement* outCaps = gst_element_factory_make("capsfilter", nullptr);
+            g_assert(outCaps != nullptr);
+            setChainResolution(FALSE);
+            GstCaps* full = gst_caps_new_simple(
+                "video/x-raw", "width", G_TYPE_INT, width, "height", G_TYPE_INT, height, NULL);
+            g_object_set(outCaps, "caps", full, NULL);
+            gst_caps_unref(full);
+
+            gst_bin_add_many(GST_BIN(pipeline), scaleDown, chainCaps, scaleUp, outCaps, nullptr);
+            gst_element_link_many(src, filter, q1, scaleDown, chainCaps, convBefore, nullptr);
+            gst_element_link_many(
+                convBefore, effect, convAfter, scaleUp, outCaps, q2, sink, nullptr);
+            profileEffect(effect);
+        } else {
+            gst_element_link_many(
+                src, filter, q1, convBefore, effect, convAfter, q2, sink, nullptr);
+        }
+    }
 
     if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
         g_error("Error starting pipeline");
         return EXIT_FAILURE;
     }
+    if (prewarm and not dual and not g_queue_is_empty(&effects)) {
+        nextEffect = static_cast<GstElement*>(g_queue_pop_head(&effects));
+        nextNegotiated = prepareEffect(nextEffect);
+    }
 
     GMainLoop* loop = g_main_loop_new(nullptr, FALSE);
     g_assert(loop != nullptr);
     gst_bus_add_watch(GST_ELEMENT_BUS(pipeline), onBusMessage, loop);
-    g_timeout_add_seconds(1, onTimeout, loop);
+    if (adaptive) {
+        g_timeout_add(kControlInterval, onControlTick, loop);
+    } else {
+        g_timeout_add_seconds(1, dual ? onFlipTimeout : onTimeout, loop);
+    }
     g_main_loop_run(loop);
 
     gst_element_set_state(pipeline, GST_STATE_NULL);
 
-    gst_object_unref(blockpad);
+    if (flips > 0) {
+        g_print("%u flips (dual path): main path blocked 0 ms, max frame gap %.1f ms, "
+                "%" G_GUINT64_FORMAT " frames dropped\n",
+                flips,
+                frameGapMax / gdouble(G_TIME_SPAN_MILLISECOND),
+                droppedTotal);
+    }
+    if (switches > 0) {
+        g_print("%u switches (%s): blocked %.2f ms mean, %.2f ms max, max frame gap %.1f ms, "
+                "%" G_GUINT64_FORMAT " frames dropped\n",
+                switches,
+                prewarm ? "pre-warmed" : "cold",
+                blockedTotal / gdouble(switches) / G_TIME_SPAN_MILLISECOND,
+                blockedMax / gdouble(G_TIME_SPAN_MILLISECOND),
+                frameGapMax / gdouble(G_TIME_SPAN_MILLISECOND),
+                droppedTotal);
+        for (const auto& [name, latency] : latencies) {
+            g_print("  %-14s %-8s %4u switches, %.2f ms mean, %.2f ms max\n",
+                    name.c_str(),
+                    latency.drained ? "drained" : "fast",
+                    latency.count,
+                    latency.total / gdouble(latency.count) / G_TIME_SPAN_MILLISECOND,
+                    latency.max / gdouble(G_TIME_SPAN_MILLISECOND));
+        }
+    }
+
+    if (not effectCosts.empty()) {
+        g_print("Effect cost per frame (budget %.2f ms):\n",
+                frameInterval / gdouble(G_TIME_SPAN_MILLISECOND));
+        for (const auto& [name, cost] : effectCosts) {
+            g_print("  %-14s %.2f ms\n", name.c_str(), cost / gdouble(G_TIME_SPAN_MILLISECOND));
+        }
+    }
+
+    g_clear_pointer(&blockpad, gst_object_unref);
+    for (Slot& slot : slots) {
+        if (slot.selectorPad != nullptr) {
+            gst_element_release_request_pad(selector, slot.selectorPad);
+            g_clear_pointer(&slot.selectorPad, gst_object_unref);
+        }
+        g_clear_pointer(&slot.effect, gst_object_unref);
+    }
     gst_bus_remove_watch(GST_ELEMENT_BUS(pipeline));
     gst_object_unref(pipeline);
     g_main_loop_unref(loop);
 
     g_queue_clear_full(&effects, gst_object_unref);
-    gst_object_unref(curEffect);
+    g_clear_pointer(&curEffect, gst_object_unref);
+    g_clear_pointer(&nextEffect, gst_object_unref);
+    g_clear_pointer(&retiredEffect, gst_object_unref);
+    g_clear_pointer(&pendingTarget, gst_object_unref);
+    g_clear_pointer(&controller.original, g_free);
+    g_hash_table_destroy(fallbacks);
     g_strfreev(effectNames);
+    g_strfreev(statelessNames);
 
     return EXIT_SUCCESS;
 }